@@ -19,6 +19,20 @@ LOCAL_C_INCLUDES := $(LOCAL_PATH)/../../../../ \
 
 LOCAL_SRC_FILES		:=	../../../Src/main.cpp \
 						../../../Src/Emulator.cpp \
+						../../../Src/FramePacer.cpp \
+						../../../Src/AudioRingBuffer.cpp \
+						../../../Src/AudioOutput.cpp \
+						../../../Src/AudioResampler.cpp \
+						../../../Src/RewindBuffer.cpp \
+						../../../Src/SaveWriter.cpp \
+						../../../Src/StateFile.cpp \
+						../../../Src/SlotContainer.cpp \
+						../../../Src/ThumbnailCache.cpp \
+						../../../Src/RomCatalog.cpp \
+						../../../Src/MappedFile.cpp \
+						../../../Src/TraceRecorder.cpp \
+						../../../Src/PixelBufferRing.cpp \
+						../../../Src/InputMovie.cpp \
 						../../../../FrontendGo/TextureLoader.cpp \
 						../../../../FrontendGo/Audio/OpenSLWrap.cpp \
 						../../../../FrontendGo/LayerBuilder.cpp \
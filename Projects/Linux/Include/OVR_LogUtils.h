@@ -0,0 +1,7 @@
+#pragma once
+
+// stands in for the ovr sdk logging so the shared sources build for the headless runner
+#include <cstdio>
+
+#define OVR_LOG(...) do { fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); } while (0)
+#define OVR_LOG_WITH_TAG(tag, ...) OVR_LOG(__VA_ARGS__)
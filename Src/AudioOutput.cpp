@@ -0,0 +1,94 @@
+#include "AudioOutput.h"
+
+#include <OVR_LogUtils.h>
+
+bool AudioOutput::Init(uint32_t latencyFrames) {
+    // the ring can hold a few times the target latency before the producer starts dropping samples
+    ringBuffer.Init(latencyFrames * 4, latencyFrames);
+
+    if (slCreateEngine(&engineObject, 0, nullptr, 0, nullptr, nullptr) != SL_RESULT_SUCCESS ||
+        (*engineObject)->Realize(engineObject, SL_BOOLEAN_FALSE) != SL_RESULT_SUCCESS ||
+        (*engineObject)->GetInterface(engineObject, SL_IID_ENGINE, &engine) != SL_RESULT_SUCCESS) {
+        OVR_LOG("AudioOutput: failed to create the engine");
+        Shutdown();
+        return false;
+    }
+
+    if ((*engine)->CreateOutputMix(engine, &outputMixObject, 0, nullptr, nullptr) != SL_RESULT_SUCCESS ||
+        (*outputMixObject)->Realize(outputMixObject, SL_BOOLEAN_FALSE) != SL_RESULT_SUCCESS) {
+        OVR_LOG("AudioOutput: failed to create the output mix");
+        Shutdown();
+        return false;
+    }
+
+    SLDataLocator_AndroidSimpleBufferQueue bufferQueueLocator = {SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE, 2};
+    SLDataFormat_PCM pcmFormat = {SL_DATAFORMAT_PCM, AudioRingBuffer::Channels, SL_SAMPLINGRATE_44_1,
+                                  SL_PCMSAMPLEFORMAT_FIXED_16, SL_PCMSAMPLEFORMAT_FIXED_16,
+                                  SL_SPEAKER_FRONT_LEFT | SL_SPEAKER_FRONT_RIGHT, SL_BYTEORDER_LITTLEENDIAN};
+    SLDataSource audioSource = {&bufferQueueLocator, &pcmFormat};
+
+    SLDataLocator_OutputMix outputMixLocator = {SL_DATALOCATOR_OUTPUTMIX, outputMixObject};
+    SLDataSink audioSink = {&outputMixLocator, nullptr};
+
+    const SLInterfaceID interfaceIds[1] = {SL_IID_BUFFERQUEUE};
+    const SLboolean interfaceRequired[1] = {SL_BOOLEAN_TRUE};
+
+    if ((*engine)->CreateAudioPlayer(engine, &playerObject, &audioSource, &audioSink, 1, interfaceIds, interfaceRequired) != SL_RESULT_SUCCESS ||
+        (*playerObject)->Realize(playerObject, SL_BOOLEAN_FALSE) != SL_RESULT_SUCCESS ||
+        (*playerObject)->GetInterface(playerObject, SL_IID_PLAY, &player) != SL_RESULT_SUCCESS ||
+        (*playerObject)->GetInterface(playerObject, SL_IID_BUFFERQUEUE, &bufferQueue) != SL_RESULT_SUCCESS ||
+        (*bufferQueue)->RegisterCallback(bufferQueue, BufferQueueCallback, this) != SL_RESULT_SUCCESS) {
+        OVR_LOG("AudioOutput: failed to create the audio player");
+        Shutdown();
+        return false;
+    }
+
+    return true;
+}
+
+void AudioOutput::Shutdown() {
+    if (playerObject) {
+        // the play interface is missing if Init failed before getting it
+        if (player)
+            (*player)->SetPlayState(player, SL_PLAYSTATE_STOPPED);
+        (*playerObject)->Destroy(playerObject);
+        playerObject = nullptr;
+        player = nullptr;
+        bufferQueue = nullptr;
+    }
+    if (outputMixObject) {
+        (*outputMixObject)->Destroy(outputMixObject);
+        outputMixObject = nullptr;
+    }
+    if (engineObject) {
+        (*engineObject)->Destroy(engineObject);
+        engineObject = nullptr;
+        engine = nullptr;
+    }
+    playing = false;
+}
+
+void AudioOutput::StartPlaying() {
+    if (playing || !player)
+        return;
+    playing = true;
+
+    // keep both chunks queued; every finished chunk gets refilled in the callback
+    // the callback only starts firing after the play state is set
+    EnqueueChunk();
+    EnqueueChunk();
+
+    (*player)->SetPlayState(player, SL_PLAYSTATE_PLAYING);
+}
+
+void AudioOutput::BufferQueueCallback(SLAndroidSimpleBufferQueueItf queue, void *context) {
+    ((AudioOutput *) context)->EnqueueChunk();
+}
+
+void AudioOutput::EnqueueChunk() {
+    int16_t *chunk = chunks[currentChunk];
+    currentChunk = (currentChunk + 1) % 2;
+
+    ringBuffer.Read(chunk, ChunkFrames);
+    (*bufferQueue)->Enqueue(bufferQueue, chunk, sizeof(chunks[0]));
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <SLES/OpenSLES.h>
+#include <SLES/OpenSLES_Android.h>
+
+#include "AudioRingBuffer.h"
+
+// OpenSL ES stream that plays the samples from an AudioRingBuffer
+// the buffer queue callback pulls fixed sized chunks so the emulation never writes to the device directly
+class AudioOutput {
+public:
+    static const int SampleRate = 44100;
+    // frames per buffer queue chunk
+    static const int ChunkFrames = 256;
+
+    bool Init(uint32_t latencyFrames);
+
+    void Shutdown();
+
+    void StartPlaying();
+
+    // called by the producer; returns the number of written frames
+    uint32_t Write(const int16_t *samples, uint32_t frameCount) { return ringBuffer.Write(samples, frameCount); }
+
+    const AudioRingBuffer &Buffer() const { return ringBuffer; }
+
+private:
+    AudioRingBuffer ringBuffer;
+
+    SLObjectItf engineObject = nullptr;
+    SLEngineItf engine = nullptr;
+    SLObjectItf outputMixObject = nullptr;
+    SLObjectItf playerObject = nullptr;
+    SLPlayItf player = nullptr;
+    SLAndroidSimpleBufferQueueItf bufferQueue = nullptr;
+
+    int16_t chunks[2][ChunkFrames * AudioRingBuffer::Channels];
+    int currentChunk = 0;
+    bool playing = false;
+
+    static void BufferQueueCallback(SLAndroidSimpleBufferQueueItf queue, void *context);
+
+    void EnqueueChunk();
+};
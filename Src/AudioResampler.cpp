@@ -0,0 +1,107 @@
+#include "AudioResampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+inline int16_t ToSample(float value) {
+    return (int16_t) std::max(-32768.0f, std::min(32767.0f, value));
+}
+
+// 4 tap dot products of the catmull-rom weights with the left and the right channel
+inline void Interpolate(const float *weights, const float *left, const float *right, float &outLeft, float &outRight) {
+#if defined(__ARM_NEON)
+    float32x4_t w = vld1q_f32(weights);
+    outLeft = vaddvq_f32(vmulq_f32(w, vld1q_f32(left)));
+    outRight = vaddvq_f32(vmulq_f32(w, vld1q_f32(right)));
+#elif defined(__SSE2__)
+    __m128 w = _mm_loadu_ps(weights);
+    __m128 l = _mm_mul_ps(w, _mm_loadu_ps(left));
+    __m128 r = _mm_mul_ps(w, _mm_loadu_ps(right));
+    // l0+l2 l1+l3 r0+r2 r1+r3
+    __m128 sum = _mm_add_ps(_mm_movelh_ps(l, r), _mm_movehl_ps(r, l));
+    // (l0+l2)+(l1+l3) and (r0+r2)+(r1+r3)
+    sum = _mm_add_ps(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    outLeft = _mm_cvtss_f32(sum);
+    outRight = _mm_cvtss_f32(_mm_shuffle_ps(sum, sum, _MM_SHUFFLE(2, 2, 2, 2)));
+#else
+    outLeft = weights[0] * left[0] + weights[1] * left[1] + weights[2] * left[2] + weights[3] * left[3];
+    outRight = weights[0] * right[0] + weights[1] * right[1] + weights[2] * right[2] + weights[3] * right[3];
+#endif
+}
+
+}
+
+void AudioResampler::Init(double inputRate, double outputRate, double _maxDeviation) {
+    baseRatio = outputRate / inputRate;
+    maxDeviation = _maxDeviation;
+    ratio = baseRatio;
+
+    // one frame of silence in front so the first output frame has a predecessor
+    left.assign(1, 0.0f);
+    right.assign(1, 0.0f);
+    position = 1;
+}
+
+void AudioResampler::Adjust(uint32_t fillLevel, uint32_t targetLevel) {
+    if (targetLevel == 0)
+        return;
+
+    // a fuller buffer means less output per input and the other way around
+    double deviation = ((double) fillLevel - targetLevel) / targetLevel;
+    deviation = std::max(-1.0, std::min(1.0, deviation));
+    ratio = baseRatio * (1.0 - maxDeviation * deviation);
+}
+
+uint32_t AudioResampler::Process(const int16_t *input, uint32_t inputFrames) {
+    size_t start = left.size();
+    left.resize(start + inputFrames);
+    right.resize(start + inputFrames);
+    for (uint32_t i = 0; i < inputFrames; ++i) {
+        left[start + i] = input[i * 2];
+        right[start + i] = input[i * 2 + 1];
+    }
+
+    size_t frameCount = left.size();
+    double step = 1.0 / ratio;
+
+    output.resize((size_t) ((frameCount - position) * ratio + 2) * 2);
+    uint32_t outputFrames = 0;
+
+    // every output frame needs one frame before and two frames after its position
+    while (position + 2 < frameCount) {
+        size_t index = (size_t) position;
+        float t = (float) (position - index);
+        float t2 = t * t;
+        float t3 = t2 * t;
+
+        float weights[4] = {
+                0.5f * (-t3 + 2 * t2 - t),
+                0.5f * (3 * t3 - 5 * t2 + 2),
+                0.5f * (-3 * t3 + 4 * t2 + t),
+                0.5f * (t3 - t2)};
+
+        float outLeft, outRight;
+        Interpolate(weights, &left[index - 1], &right[index - 1], outLeft, outRight);
+        output[outputFrames * 2] = ToSample(outLeft);
+        output[outputFrames * 2 + 1] = ToSample(outRight);
+        outputFrames++;
+
+        position += step;
+    }
+
+    // keep the frames that are still needed for the next call
+    size_t consumed = (size_t) position - 1;
+    left.erase(left.begin(), left.begin() + consumed);
+    right.erase(right.begin(), right.begin() + consumed);
+    position -= consumed;
+
+    return outputFrames;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// cubic stereo resampler with dynamic rate control
+// the ratio gets nudged by a fraction of a percent depending on the fill level of the output buffer,
+// which keeps the latency steady without locking the emulation to the audio clock
+class AudioResampler {
+public:
+    // maxDeviation is the largest allowed ratio change; 0.005 means 0.5%
+    void Init(double inputRate, double outputRate, double maxDeviation);
+
+    // called before every Process with the fill level of the buffer the output gets written to
+    void Adjust(uint32_t fillLevel, uint32_t targetLevel);
+
+    // resamples interleaved stereo frames; the output stays valid until the next call
+    uint32_t Process(const int16_t *input, uint32_t inputFrames);
+
+    const int16_t *Output() const { return output.data(); }
+
+    // current output frames per input frame
+    double Ratio() const { return ratio; }
+
+private:
+    double baseRatio = 1;
+    double maxDeviation = 0;
+    double ratio = 1;
+
+    // planar input including the frames needed from the previous call
+    std::vector<float> left, right;
+    // position of the next output frame in input frames
+    double position = 1;
+
+    std::vector<int16_t> output;
+};
@@ -0,0 +1,69 @@
+#include "AudioRingBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+void AudioRingBuffer::Init(uint32_t capacityFrames, uint32_t _targetFrames) {
+    capacity = 1;
+    while (capacity < capacityFrames)
+        capacity <<= 1;
+    mask = capacity - 1;
+    targetFrames = std::min(_targetFrames, capacity);
+
+    buffer.assign(capacity * Channels, 0);
+    writePosition.store(0);
+    readPosition.store(0);
+    buffering = true;
+}
+
+uint32_t AudioRingBuffer::Write(const int16_t *samples, uint32_t frameCount) {
+    uint32_t write = writePosition.load(std::memory_order_relaxed);
+    uint32_t read = readPosition.load(std::memory_order_acquire);
+
+    uint32_t space = capacity - (write - read);
+    if (frameCount > space) {
+        overruns.fetch_add(1, std::memory_order_relaxed);
+        frameCount = space;
+    }
+
+    // copy in up to two parts because of the wrap around
+    uint32_t start = write & mask;
+    uint32_t first = std::min(frameCount, capacity - start);
+    memcpy(&buffer[start * Channels], samples, first * Channels * sizeof(int16_t));
+    memcpy(&buffer[0], samples + first * Channels, (frameCount - first) * Channels * sizeof(int16_t));
+
+    writePosition.store(write + frameCount, std::memory_order_release);
+    return frameCount;
+}
+
+void AudioRingBuffer::Read(int16_t *samples, uint32_t frameCount) {
+    uint32_t read = readPosition.load(std::memory_order_relaxed);
+    uint32_t available = writePosition.load(std::memory_order_acquire) - read;
+
+    if (buffering) {
+        if (available < targetFrames) {
+            memset(samples, 0, frameCount * Channels * sizeof(int16_t));
+            return;
+        }
+        buffering = false;
+    }
+
+    uint32_t count = frameCount;
+    if (available < frameCount) {
+        underruns.fetch_add(1, std::memory_order_relaxed);
+        buffering = true;
+        count = available;
+    }
+
+    uint32_t start = read & mask;
+    uint32_t first = std::min(count, capacity - start);
+    memcpy(samples, &buffer[start * Channels], first * Channels * sizeof(int16_t));
+    memcpy(samples + first * Channels, &buffer[0], (count - first) * Channels * sizeof(int16_t));
+    memset(samples + count * Channels, 0, (frameCount - count) * Channels * sizeof(int16_t));
+
+    readPosition.store(read + count, std::memory_order_release);
+}
+
+uint32_t AudioRingBuffer::FillLevel() const {
+    return writePosition.load(std::memory_order_acquire) - readPosition.load(std::memory_order_acquire);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// lock free single producer single consumer ring buffer for interleaved stereo samples
+// the producer is the emulation thread, the consumer is the audio callback
+class AudioRingBuffer {
+public:
+    static const int Channels = 2;
+
+    // capacity gets rounded up to a power of two; playback (re)starts once targetFrames are buffered
+    void Init(uint32_t capacityFrames, uint32_t _targetFrames);
+
+    // producer side; frames that do not fit get dropped and counted as an overrun
+    uint32_t Write(const int16_t *samples, uint32_t frameCount);
+
+    // consumer side; always fills frameCount frames, missing frames are silence and counted as an underrun
+    void Read(int16_t *samples, uint32_t frameCount);
+
+    uint32_t FillLevel() const;
+
+    uint32_t TargetFrames() const { return targetFrames; }
+
+    uint32_t Capacity() const { return capacity; }
+
+    uint64_t Underruns() const { return underruns.load(std::memory_order_relaxed); }
+
+    uint64_t Overruns() const { return overruns.load(std::memory_order_relaxed); }
+
+private:
+    std::vector<int16_t> buffer;
+    uint32_t capacity = 0;
+    uint32_t mask = 0;
+    uint32_t targetFrames = 0;
+
+    // positions only ever increase; the difference is the fill level
+    std::atomic<uint32_t> writePosition{0};
+    std::atomic<uint32_t> readPosition{0};
+
+    // consumer only; set after an underrun until the buffer is filled up to the target again
+    bool buffering = true;
+
+    std::atomic<uint64_t> underruns{0};
+    std::atomic<uint64_t> overruns{0};
+};
@@ -4,11 +4,11 @@
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <cmath>
 
 #include <BeetleVBLibretroGo/mednafen/vrvb.h>
 #include <OVR_LogUtils.h>
 
-#include "Audio/OpenSLWrap.h"
 #include "DrawHelper.h"
 #include "FontMaster.h"
 #include "LayerBuilder.h"
@@ -16,6 +16,7 @@
 #include "Global.h"
 
 #include "main.h"
+#include "StateFile.h"
 
 template<typename T>
 std::string ToString(T value) {
@@ -110,6 +111,8 @@ void Emulator::InitSettingsMenu(int &posX, int &posY, Menu &settingsMenu) {
     button_icons[11] = &ovrVirtualBoyGo::global.mappingSelectId;
     button_icons[12] = &ovrVirtualBoyGo::global.mappingRightLeftId;
     button_icons[13] = &ovrVirtualBoyGo::global.mappingRightDownId;
+    button_icons[14] = &rewindIconId;
+    button_icons[15] = &fastForwardIconId;
 
     //MenuButton *curveButton =
     //    new MenuButton(&fontMenu, texturePaletteIconId, "", posX, posY += menuItemSize,
@@ -147,9 +150,53 @@ void Emulator::InitSettingsMenu(int &posX, int &posY, Menu &settingsMenu) {
     settingsMenu.MenuItems.push_back(gButton);
     settingsMenu.MenuItems.push_back(bButton);
 
+    runAheadButton = std::make_unique<MenuButton>(&ovrVirtualBoyGo::global.fontMenu, ovrVirtualBoyGo::global.textureVbIconId, "", posX,
+                                                  posY += menuItemSize + 5,
+                                                  std::bind(&Emulator::OnClickRunAheadRight, this, _1),
+                                                  std::bind(&Emulator::OnClickRunAheadLeft, this, _1),
+                                                  std::bind(&Emulator::OnClickRunAheadRight, this, _1));
+    runAheadButton->UpdateFunction = std::bind(&Emulator::UpdateRunAheadLabel, this, _1, _2, _3);
+    settingsMenu.MenuItems.push_back(runAheadButton);
+
+    fastForwardSpeedButton = std::make_unique<MenuButton>(&ovrVirtualBoyGo::global.fontMenu, ovrVirtualBoyGo::global.textureVbIconId, "", posX,
+                                                          posY += menuItemSize,
+                                                          std::bind(&Emulator::OnClickFastForwardRight, this, _1),
+                                                          std::bind(&Emulator::OnClickFastForwardLeft, this, _1),
+                                                          std::bind(&Emulator::OnClickFastForwardRight, this, _1));
+    fastForwardSpeedButton->UpdateFunction = std::bind(&Emulator::UpdateFastForwardLabel, this, _1, _2, _3);
+    settingsMenu.MenuItems.push_back(fastForwardSpeedButton);
+
+    rewindBudgetButton = std::make_unique<MenuButton>(&ovrVirtualBoyGo::global.fontMenu, ovrVirtualBoyGo::global.textureVbIconId, "", posX,
+                                                      posY += menuItemSize,
+                                                      std::bind(&Emulator::OnClickRewindBudgetRight, this, _1),
+                                                      std::bind(&Emulator::OnClickRewindBudgetLeft, this, _1),
+                                                      std::bind(&Emulator::OnClickRewindBudgetRight, this, _1));
+    rewindBudgetButton->UpdateFunction = std::bind(&Emulator::UpdateRewindBudgetLabel, this, _1, _2, _3);
+    settingsMenu.MenuItems.push_back(rewindBudgetButton);
+
+    traceButton = std::make_unique<MenuButton>(&ovrVirtualBoyGo::global.fontMenu, ovrVirtualBoyGo::global.textureVbIconId, "Save trace", posX,
+                                               posY += menuItemSize,
+                                               std::bind(&Emulator::OnClickSaveTrace, this, _1), nullptr, nullptr);
+    settingsMenu.MenuItems.push_back(traceButton);
+
+    recordMovieButton = std::make_unique<MenuButton>(&ovrVirtualBoyGo::global.fontMenu, ovrVirtualBoyGo::global.textureVbIconId, "", posX,
+                                                     posY += menuItemSize,
+                                                     std::bind(&Emulator::OnClickRecordMovie, this, _1), nullptr, nullptr);
+    recordMovieButton->UpdateFunction = std::bind(&Emulator::UpdateMovieLabels, this, _1, _2, _3);
+    settingsMenu.MenuItems.push_back(recordMovieButton);
+
+    playMovieButton = std::make_unique<MenuButton>(&ovrVirtualBoyGo::global.fontMenu, ovrVirtualBoyGo::global.textureVbIconId, "", posX,
+                                                   posY += menuItemSize,
+                                                   std::bind(&Emulator::OnClickPlayMovie, this, _1), nullptr, nullptr);
+    settingsMenu.MenuItems.push_back(playMovieButton);
+    UpdateMovieLabels(recordMovieButton.get(), nullptr, nullptr);
+
     ChangeOffset(offsetButton.get(), 0);
     SetThreeDeeMode(screenModeButton.get(), useThreeDeeMode);
     ChangePalette(paletteButton.get(), 0);
+    ChangeRunAhead(runAheadButton.get(), 0);
+    ChangeFastForwardSpeed(fastForwardSpeedButton.get(), 0);
+    ChangeRewindBudget(rewindBudgetButton.get(), 0);
 }
 
 void Emulator::OnClickRLeft(MenuItem *item) { ChangeColor((MenuButton *) item, 0, -COLOR_STEP_SIZE); }
@@ -174,11 +221,11 @@ void Emulator::ChangeColor(MenuButton *item, int colorIndex, float dir) {
 
     item->Text = strColor[colorIndex] + ToString(color[colorIndex]);
 
-    // update screen
+    // the color is applied while drawing so the images only need to be redrawn
     if (currentScreenData)
-        UpdateScreen(currentScreenData);
-    // update save slot color
-    UpdateStateImage(ovrVirtualBoyGo::global.saveSlot);
+        DrawScreen();
+    if (imageSlot)
+        imageSlot->Color = {color[0], color[1], color[2], 1.0f};
 }
 
 void Emulator::InitRomSelectionMenu(int posX, int posY, Menu &romSelectionMenu) {
@@ -194,24 +241,45 @@ void Emulator::InitRomSelectionMenu(int posX, int posY, Menu &romSelectionMenu)
 }
 
 void Emulator::Free() {
+    StopEmulationThread();
+    rewindBuffer.Shutdown();
+    // the save writer finishes the writes before it stops
+    {
+        std::lock_guard<std::mutex> lock(coreMutex);
+        StopMovie();
+    }
+    SaveRam();
+    saveWriter.Shutdown();
+    thumbnailCache.Shutdown();
+    romCatalog.Shutdown();
+    slotContainer.Close();
     VRVB::unload_game();
 
+    glDeleteFramebuffers((GLsizei) screenFramebuffers.size(), screenFramebuffers.data());
+    screenFramebuffers.clear();
     vrapi_DestroyTextureSwapChain(CylinderSwapChain);
 
+    screenUpload.Shutdown();
     glBindTexture(GL_TEXTURE_2D, 0);
     glDeleteTextures(1, &screenTextureId);
     glDeleteTextures(1, &stateImageId);
+    glDeleteTextures(1, &rewindIconId);
+    glDeleteTextures(1, &fastForwardIconId);
 }
 
-void Emulator::Init(std::string appFolderPath, LayerBuilder *_layerBuilder, DrawHelper *_drawHelper, OpenSLWrapper *openSLWrap) {
+void Emulator::Init(std::string appFolderPath, LayerBuilder *_layerBuilder, DrawHelper *_drawHelper, AudioOutput *_audioOutput) {
     stateFolderPath = appFolderPath + stateFilePath;
+    traceFilePath = appFolderPath + romFolderPath + "trace.json";
 
     layerBuilder = _layerBuilder;
     drawHelper = _drawHelper;
 
-    openSlWrap = openSLWrap;
+    audioOutput = _audioOutput;
+    audioResampler.Init(CoreSampleRate, AudioOutput::SampleRate, 0.005);
 
-    romFileList.clear();
+    // the roms of the last run are shown until the scan is done
+    romCatalog.Init(stateFolderPath + "romcatalog", appFolderPath + romFolderPath, supportedFileNames);
+    SetRomList(*romCatalog.List());
 
     // set the button mapping
     ResetButtonMapping();
@@ -219,22 +287,17 @@ void Emulator::Init(std::string appFolderPath, LayerBuilder *_layerBuilder, Draw
     OVR_LOG("VRVB INIT w %i, %i, %i, %i", CylinderWidth, CylinderHeight, VIDEO_WIDTH, VIDEO_HEIGHT);
     // emu screen layer
     // left layer
-    int cubeSizeX = CylinderWidth;
-    int cubeSizeY = CylinderWidth;
-
     screenPosY = CylinderWidth / 2 - CylinderHeight / 2;
     OVR_LOG("screePosY %i", screenPosY);
 
-    for (int y = 0; y < cubeSizeY; ++y) {
-        for (int x = 0; x < cubeSizeX; ++x) {
-            pixelData[x + y * cubeSizeX] = 0xFFFF00FF;
-        }
-    }
     GLfloat borderColor[] = {1.0f, 0.0f, 0.0f, 1.0f};
 
+    // the screen texture only stores the brightness values; the rows between the two images are never written and stay black
+    std::vector<uint8_t> emptyScreen(VIDEO_WIDTH * (VIDEO_HEIGHT * 2 + screenborder * 4), 0);
     glGenTextures(1, &screenTextureId);
     glBindTexture(GL_TEXTURE_2D, screenTextureId);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, VIDEO_WIDTH, VIDEO_HEIGHT * 2 + screenborder * 4, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, VIDEO_WIDTH, VIDEO_HEIGHT * 2 + screenborder * 4, 0, GL_RED, GL_UNSIGNED_BYTE, emptyScreen.data());
+    SetLuminanceSwizzle();
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -244,30 +307,40 @@ void Emulator::Init(std::string appFolderPath, LayerBuilder *_layerBuilder, Draw
     glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
     glBindTexture(GL_TEXTURE_2D, 0);
 
+    screenUpload.Init(VIDEO_WIDTH * TextureHeight, FrameMailbox::BufferCount);
+    videoFrame.assign(VIDEO_WIDTH * TextureHeight, 0);
+
     {
         int borderSize = screenborder;
         // left texture
         CylinderSwapChain =
-                vrapi_CreateTextureSwapChain(VRAPI_TEXTURE_TYPE_2D, VRAPI_TEXTURE_FORMAT_8888_sRGB, CylinderWidth * 2 + borderSize * 2,
-                                             TextureHeight * 2 + borderSize * 2, 1, false);
-        screenTextureCylinderId = vrapi_GetTextureSwapChainHandle(CylinderSwapChain, 0);
-
-        glBindTexture(GL_TEXTURE_2D, screenTextureCylinderId);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, CylinderWidth * 2 + borderSize * 2, TextureHeight * 2 + borderSize * 2, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        //glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-        glBindTexture(GL_TEXTURE_2D, 0);
-
-        // create the framebuffer for the screen texture
-        glGenFramebuffers(1, &screenFramebuffer[0]);
-        glBindFramebuffer(GL_FRAMEBUFFER, screenFramebuffer[0]);
-        // Set "renderedTexture" as our colour attachement #0
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, screenTextureCylinderId, 0);
-        // Set the list of draw buffers.
-        GLenum DrawBuffers[1] = {GL_COLOR_ATTACHMENT0};
-        glDrawBuffers(1, DrawBuffers);
+                vrapi_CreateTextureSwapChain3(VRAPI_TEXTURE_TYPE_2D, GL_SRGB8_ALPHA8, CylinderWidth * 2 + borderSize * 2,
+                                              TextureHeight * 2 + borderSize * 2, 1, CylinderSwapChainLength);
+
+        // one framebuffer for every image of the swap chain
+        screenFramebuffers.resize(vrapi_GetTextureSwapChainLength(CylinderSwapChain));
+        for (int i = 0; i < (int) screenFramebuffers.size(); ++i) {
+            GLuint imageId = vrapi_GetTextureSwapChainHandle(CylinderSwapChain, i);
+
+            glBindTexture(GL_TEXTURE_2D, imageId);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glBindTexture(GL_TEXTURE_2D, 0);
+
+            glGenFramebuffers(1, &screenFramebuffers[i]);
+            glBindFramebuffer(GL_FRAMEBUFFER, screenFramebuffers[i]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, imageId, 0);
+            GLenum DrawBuffers[1] = {GL_COLOR_ATTACHMENT0};
+            glDrawBuffers(1, DrawBuffers);
+
+            // start with a black screen in all images
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+        }
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        cylinderImageIndex = 0;
+        screenTextureCylinderId = vrapi_GetTextureSwapChainHandle(CylinderSwapChain, cylinderImageIndex);
     }
 
     OVR_LOG("INIT VRVB");
@@ -277,10 +350,35 @@ void Emulator::Init(std::string appFolderPath, LayerBuilder *_layerBuilder, Draw
     VRVB::audio_cb = std::bind(&Emulator::VB_Audio_CB, this, std::placeholders::_1, std::placeholders::_2);
     VRVB::video_cb = std::bind(&Emulator::VB_VIDEO_CB, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
 
+    // frames are stored in the layout of the screen texture; with persistent pixel buffers the emulation thread writes them straight into the buffers
+    if (screenUpload.Persistent()) {
+        uint8_t *uploadBuffers[FrameMailbox::BufferCount];
+        for (int i = 0; i < FrameMailbox::BufferCount; ++i)
+            uploadBuffers[i] = screenUpload.Data(i);
+        frameMailbox.Init(VIDEO_WIDTH * TextureHeight, uploadBuffers);
+    } else {
+        frameMailbox.Init(VIDEO_WIDTH * TextureHeight);
+    }
+    framePacer.Init(emulationSpeed, emulationSpeed);
+    rewindBudgetBytes = (size_t) rewindBudget * 1024 * 1024;
+    appliedRewindBudget = rewindBudgetBytes.load();
+    rewindBuffer.Init(appliedRewindBudget);
+    saveWriter.Init();
+    slotImage.resize(VIDEO_WIDTH * VIDEO_HEIGHT);
+    thumbnailCache.Init(VIDEO_WIDTH * VIDEO_HEIGHT, ThumbnailCacheSize, [this](int slot, uint8_t *image) {
+        return slotContainer.ReadImage(slot, image, VIDEO_WIDTH * VIDEO_HEIGHT);
+    });
+    StartEmulationThread();
+
     InitStateImage();
+    rewindIconId = CreateArrowIcon(false);
+    fastForwardIconId = CreateArrowIcon(true);
     currentGame = new LoadedGame();
     for (int i = 0; i < 10; ++i) {
-        currentGame->saveStates[i].saveImage = new uint8_t[VIDEO_WIDTH * 2 * VIDEO_HEIGHT]();
+        currentGame->saveStates[i].hasImage = false;
+        currentGame->saveStates[i].hasState = false;
+        currentGame->saveStates[i].pendingWrites = 0;
+        currentGame->saveStates[i].writeFailed = false;
     }
 
     Vector3f size(5.25f, 5.25f * (VIDEO_HEIGHT / (float) VIDEO_WIDTH), 0.0f);
@@ -289,10 +387,19 @@ void Emulator::Init(std::string appFolderPath, LayerBuilder *_layerBuilder, Draw
     SceneScreenBounds.Translate(Vector3f(0.0f, 1.66f, -5.61f));
 }
 
+// single channel textures get sampled as (r, r, r, 1) so the draw color can tint them
+void Emulator::SetLuminanceSwizzle() {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_RED);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_ONE);
+}
+
 void Emulator::InitStateImage() {
     glGenTextures(1, &stateImageId);
     glBindTexture(GL_TEXTURE_2D, stateImageId);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, VIDEO_WIDTH, VIDEO_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, VIDEO_WIDTH, VIDEO_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+    SetLuminanceSwizzle();
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -300,130 +407,556 @@ void Emulator::InitStateImage() {
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+// two white triangles pointing left (rewind) or right (fast-forward) on a transparent background
+GLuint Emulator::CreateArrowIcon(bool pointRight) {
+    const int iconSize = 32;
+    const int arrowSize = iconSize / 2;
+    std::vector<uint32_t> pixels(iconSize * iconSize, 0);
+    for (int y = 0; y < iconSize; ++y) {
+        for (int x = 0; x < iconSize; ++x) {
+            // distance from the tip of the triangle the pixel is in
+            int tipDistance = pointRight ? arrowSize - 1 - x % arrowSize : x % arrowSize;
+            float halfHeight = (tipDistance + 0.5f) * (iconSize - 4) / (2.0f * arrowSize);
+            if (std::fabs(y + 0.5f - iconSize / 2.0f) <= halfHeight)
+                pixels[x + y * iconSize] = 0xFFFFFFFF;
+        }
+    }
+
+    GLuint iconId;
+    glGenTextures(1, &iconId);
+    glBindTexture(GL_TEXTURE_2D, iconId);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, iconSize, iconSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return iconId;
+}
+
+// images that are not in the thumbnail cache show up empty and get uploaded by UpdateSlotImage once they are loaded
 void Emulator::UpdateStateImage(int saveSlot) {
-    glBindTexture(GL_TEXTURE_2D, stateImageId);
+    if (saveSlot != shownImageSlot) {
+        // the neighbours are most likely to be selected next
+        thumbnailCache.Prefetch((saveSlot + 1) % SlotContainer::SlotCount);
+        thumbnailCache.Prefetch((saveSlot + SlotContainer::SlotCount - 1) % SlotContainer::SlotCount);
+    }
+    shownImageSlot = saveSlot;
 
-    uint8_t *dataArray = currentGame->saveStates[saveSlot].saveImage;
-    for (int y = 0; y < VIDEO_HEIGHT; ++y) {
-        for (int x = 0; x < VIDEO_WIDTH; ++x) {
-            uint8_t das = dataArray[x + y * VIDEO_WIDTH];
-            stateImageData[x + y * VIDEO_WIDTH] =
-                    0xFF000000 | ((int) (das * color[2]) << 16) | ((int) (das * color[1]) << 8) | (int) (das * color[0]);
-        }
+    if (thumbnailCache.Get(saveSlot, slotImage.data())) {
+        shownImageLoaded = true;
+        shownImageEmpty = false;
+    } else {
+        shownImageLoaded = !currentGame->saveStates[saveSlot].hasImage;
+        if (shownImageEmpty)
+            return;
+
+        memset(slotImage.data(), 0, slotImage.size());
+        shownImageEmpty = true;
     }
 
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, VIDEO_WIDTH, VIDEO_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, stateImageData);
+    glBindTexture(GL_TEXTURE_2D, stateImageId);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, VIDEO_WIDTH, VIDEO_HEIGHT, GL_RED, GL_UNSIGNED_BYTE, slotImage.data());
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+void Emulator::UpdateSlotImage(MenuItem *item, uint *buttonState, uint *lastButtonState) {
+    if (shownImageSlot != ovrVirtualBoyGo::global.saveSlot || !shownImageLoaded)
+        UpdateStateImage(ovrVirtualBoyGo::global.saveSlot);
+}
+
 void Emulator::AudioFrame(unsigned short *audio, int32_t sampleCount) {
     if (!audioInit) {
         audioInit = true;
-        openSlWrap->StartPlaying();
+        audioOutput->StartPlaying();
     }
 
-    openSlWrap->SetBuffer(audio, (unsigned) (sampleCount * 2));
+    // the ratio follows the fill level of the ring buffer to make up for the drift between the emulation and the audio clock
+    audioResampler.Adjust(audioOutput->Buffer().FillLevel(), audioOutput->Buffer().TargetFrames());
+    uint32_t frameCount = audioResampler.Process((const int16_t *) audio, (uint32_t) sampleCount);
+
+    // the samples get queued in the ring buffer and pulled by the audio callback
+    audioOutput->Write(audioResampler.Output(), frameCount);
     // 52602
     // 877
     // OVR_LOG("VRVB audio size: %i", sampleCount);
 }
 
 void Emulator::VB_Audio_CB(int16_t *SoundBuf, int32_t SoundBufSize) {
+    if (suppressAudio)
+        return;
     AudioFrame((unsigned short *) SoundBuf, SoundBufSize);
 }
 
+// called on the emulation thread
 void Emulator::VB_VIDEO_CB(const void *data, unsigned width, unsigned height) {
     // OVR_LOG("VRVB width: %i, height: %i, %i", width, height, (((int8_t *) data)[5])); // 144 + 31 * 384
-    // update the screen texture with the newly received image
-    currentScreenData = data;
-    UpdateScreen(data);
+    if (suppressVideo)
+        return;
+
+    TraceRecorder::Scope trace("VideoCopy");
+    // left and right image are stored below each other with a 12 line gap in between
+    // the rows between the two images in the mailbox buffers are never written and stay black
+    const uint8_t *dataArray = (const uint8_t *) data;
+    uint32_t dirtyBands = 0;
+    {
+        TraceRecorder::Scope traceCompare("CompareScreen");
+        for (int eye = 0; eye < 2; ++eye) {
+            const uint8_t *eyeData = &dataArray[eye * (VIDEO_HEIGHT + 12) * VIDEO_WIDTH];
+            for (int band = 0; band < ScreenBands; ++band) {
+                const uint8_t *bandData = eyeData + band * ScreenBandRows * VIDEO_WIDTH;
+                uint8_t *bandCopy = videoFrame.data() + ScreenBandOffset(eye, band);
+                if (memcmp(bandData, bandCopy, ScreenBandRows * VIDEO_WIDTH) != 0) {
+                    memcpy(bandCopy, bandData, ScreenBandRows * VIDEO_WIDTH);
+                    dirtyBands |= 1u << (eye * ScreenBands + band);
+                }
+            }
+        }
+    }
+
+    // the buffer could hold any older frame so the whole frame gets written
+    uint8_t *frame = frameMailbox.WriteBuffer();
+    memcpy(frame, dataArray, VIDEO_WIDTH * VIDEO_HEIGHT);
+    memcpy(&frame[(VIDEO_HEIGHT + screenborder * 2) * VIDEO_WIDTH], &dataArray[(VIDEO_HEIGHT + 12) * VIDEO_WIDTH], VIDEO_WIDTH * VIDEO_HEIGHT);
+    frameDirtyBands[frameMailbox.WriteIndex()] = dirtyBands;
+    frameSequence[frameMailbox.WriteIndex()] = ++videoSequence;
+    frameMailbox.Publish(emulatedFrames.load() + 1);
+}
+
+void Emulator::StartEmulationThread() {
+    emulationRunning = true;
+    emulationThread = std::thread(&Emulator::EmulationLoop, this);
+}
+
+void Emulator::StopEmulationThread() {
+    if (!emulationThread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(scheduleMutex);
+        emulationRunning = false;
+    }
+    scheduleCondition.notify_one();
+    emulationThread.join();
+}
+
+// runs frames until the target set by the frame pacer is reached; the game is paused while Update is not getting called (menu is open)
+void Emulator::EmulationLoop() {
+    TraceRecorder::SetThreadName("emulation");
+    while (true) {
+        bool catchUp;
+        {
+            std::unique_lock<std::mutex> lock(scheduleMutex);
+            scheduleCondition.wait(lock, [this] { return !emulationRunning || emulatedFrames.load() < targetFrame; });
+            if (!emulationRunning)
+                break;
+            // more frames than this one are due; the emulation fell behind and only the last one gets shown
+            catchUp = emulatedFrames.load() + 1 < targetFrame;
+        }
+
+        std::lock_guard<std::mutex> lock(coreMutex);
+        TraceRecorder::Scope trace("EmulationFrame");
+        ApplyRewindSettings();
+        uint16_t input = inputState.load();
+        if (input != lastRunInput) {
+            lastRunInput = input;
+            std::chrono::steady_clock::duration changeTime(inputChangeTime.load());
+            inputLatency.Add(std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch() - changeTime).count());
+        }
+
+        // rewinding changes the game outside of the movie
+        if (movieMode.load() != MovieIdle && rewindHeld.load())
+            StopMovie();
+
+        if (rewindHeld.load()) {
+            SetFrameInput(input);
+            RewindFrame();
+            coreFrames++;
+        } else if (fastForwardHeld.load()) {
+            // fast-forward does not catch up on the game time it fell behind
+            if (!catchUp) {
+                FastForwardFrames(input);
+                if (rewindEnabled.load())
+                    CaptureRewindState();
+            }
+        } else {
+            SetFrameInput(input);
+            if (catchUp)
+                CatchUpFrame();
+            else
+                RunFrame();
+            coreFrames++;
+            if (rewindEnabled.load())
+                CaptureRewindState();
+        }
+        emulatedFrames++;
+
+        if (++ramCheckFrame >= RamCheckFrames) {
+            ramCheckFrame = 0;
+            FlushRam(false);
+        }
+    }
+}
+
+// needs to hold coreMutex; the movie replaces or records the input of every frame the core runs
+void Emulator::SetFrameInput(uint16_t input) {
+    if (movieMode.load() == MoviePlaying && !movie.NextFrame(input)) {
+        OVR_LOG("movie: finished");
+        movieMode = MovieIdle;
+    }
+    if (movieMode.load() == MovieRecording)
+        movie.RecordFrame(input);
+
+    VRVB::input_buf[0] = input;
 }
 
-bool Emulator::StateExists(int slot) {
-    std::string savePath = stateFolderPath + CurrentRom->RomName + ".state";
-    if (slot > 0) savePath += ToString(slot);
-    struct stat buffer;
-    return (stat(savePath.c_str(), &buffer) == 0);
+// needs to hold coreMutex
+void Emulator::RunFrame() {
+    TraceRecorder::Scope trace("RunFrame");
+    int aheadFrames = runAheadFrames.load();
+    if (aheadFrames != lastRunAheadFrames) {
+        lastRunAheadFrames = aheadFrames;
+        runAheadFrameTime = 0;
+    }
+
+    if (aheadFrames <= 0) {
+        VRVB::Run();
+        return;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    size_t stateSize = VRVB::retro_serialize_size();
+    if (runAheadState.size() != stateSize)
+        runAheadState.resize(stateSize);
+
+    // the real frame only produces the audio
+    suppressVideo = true;
+    VRVB::Run();
+
+    if (stateSize == 0 || !VRVB::retro_serialize(runAheadState.data(), stateSize)) {
+        OVR_LOG("run-ahead: failed to save the state, disable run-ahead");
+        suppressVideo = false;
+        runAheadFrames = 0;
+        return;
+    }
+
+    // run ahead with the same input and only show the last frame
+    suppressAudio = true;
+    for (int i = 1; i <= aheadFrames; ++i) {
+        suppressVideo = i != aheadFrames;
+        VRVB::Run();
+    }
+    suppressAudio = false;
+    suppressVideo = false;
+
+    VRVB::retro_unserialize(runAheadState.data(), stateSize);
+
+    // turn run-ahead off if the device can not keep up with it
+    double frameTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    runAheadFrameTime = runAheadFrameTime == 0 ? frameTime : runAheadFrameTime * 0.95 + frameTime * 0.05;
+    if (runAheadFrameTime > RunAheadBudget / emulationSpeed) {
+        OVR_LOG("run-ahead: %.2fms per frame is over budget, disable run-ahead", runAheadFrameTime * 1000);
+        runAheadFrames = 0;
+    }
+}
+
+// needs to hold coreMutex; runs a frame without its image to get back to the game time; the audio is kept
+void Emulator::CatchUpFrame() {
+    TraceRecorder::Scope trace("CatchUpFrame");
+    suppressVideo = true;
+    VRVB::Run();
+    suppressVideo = false;
+    catchUpFrames++;
+}
+
+// needs to hold coreMutex; runs the frames of one scheduled frame without run-ahead
+// the frames before the last one neither copy their image nor write their audio, so the audio keeps playing at normal speed
+void Emulator::FastForwardFrames(uint16_t input) {
+    TraceRecorder::Scope trace("FastForwardFrames");
+    int speed = fastForwardSpeed.load();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(UncappedBudget / emulationSpeed));
+
+    suppressVideo = true;
+    suppressAudio = true;
+    for (int i = 1; speed > 0 ? i < speed : std::chrono::steady_clock::now() < end; ++i) {
+        SetFrameInput(input);
+        VRVB::Run();
+        coreFrames++;
+    }
+    suppressVideo = false;
+    suppressAudio = false;
+
+    SetFrameInput(input);
+    VRVB::Run();
+    coreFrames++;
+}
+
+// needs to hold coreMutex; loads the previous state and runs it to get its image
+void Emulator::RewindFrame() {
+    TraceRecorder::Scope trace("RewindFrame");
+    size_t stateSize;
+    const uint8_t *state = rewindBuffer.StepBack(stateSize);
+    // the oldest state is reached; keep showing the last image
+    if (state == nullptr)
+        return;
+
+    VRVB::retro_unserialize(state, stateSize);
+
+    suppressAudio = true;
+    VRVB::Run();
+    suppressAudio = false;
+}
+
+// needs to hold coreMutex; called on the emulation thread so the state returned by StepBack is not freed while a rewind frame uses it
+// and the render thread does not wait for a compression to finish
+void Emulator::ApplyRewindSettings() {
+    size_t budget = rewindBudgetBytes.load();
+    if (budget != appliedRewindBudget) {
+        appliedRewindBudget = budget;
+        rewindBuffer.SetBudget(budget);
+    }
+
+    bool enabled = rewindEnabled.load();
+    if (enabled != appliedRewindEnabled) {
+        appliedRewindEnabled = enabled;
+        rewindBuffer.SetEnabled(enabled);
+    }
 }
 
-void Emulator::SaveStateImage(int slot) {
-    std::string savePath = stateFolderPath + CurrentRom->RomName + ".stateimg";
-    if (slot > 0) savePath += ToString(slot);
+// needs to hold coreMutex
+void Emulator::CaptureRewindState() {
+    TraceRecorder::Scope trace("CaptureRewindState");
+    size_t stateSize = VRVB::retro_serialize_size();
+    if (stateSize == 0)
+        return;
 
-    OVR_LOG("save image of slot to %s", savePath.c_str());
-    std::ofstream outfile(savePath, std::ios::trunc | std::ios::binary);
-    outfile.write((const char *) currentGame->saveStates[slot].saveImage,
-                  sizeof(uint8_t) * VIDEO_WIDTH * VIDEO_HEIGHT);
-    outfile.close();
-    OVR_LOG("finished writing save image to file");
+    // skip the frame if the last state is still getting compressed
+    uint8_t *buffer = rewindBuffer.BeginCapture(stateSize);
+    if (buffer == nullptr)
+        return;
+
+    if (VRVB::retro_serialize(buffer, stateSize))
+        rewindBuffer.EndCapture();
 }
 
-bool Emulator::LoadStateImage(int slot) {
-    std::string savePath = stateFolderPath + CurrentRom->RomName + ".stateimg";
-    if (slot > 0) savePath += ToString(slot);
+void Emulator::ChangeRunAhead(MenuButton *item, int dir) {
+    int frames = runAheadFrames.load() + dir;
+    if (frames < 0)
+        frames = MaxRunAheadFrames;
+    else if (frames > MaxRunAheadFrames)
+        frames = 0;
 
-    std::ifstream file(savePath, std::ios::in | std::ios::binary | std::ios::ate);
-    if (file.is_open()) {
-        uint8_t *data = new uint8_t[VIDEO_WIDTH * VIDEO_HEIGHT];
-        file.seekg(0, std::ios::beg);
-        file.read((char *) data, sizeof(uint8_t) * VIDEO_WIDTH * VIDEO_HEIGHT);
-        file.close();
+    runAheadFrames = frames;
+    UpdateRunAheadLabel(item, nullptr, nullptr);
+}
 
-        memcpy(currentGame->saveStates[slot].saveImage, data,
-               sizeof(uint8_t) * VIDEO_WIDTH * VIDEO_HEIGHT);
+// also gets called every frame so the label follows when run-ahead gets turned off
+void Emulator::UpdateRunAheadLabel(MenuItem *item, uint *buttonState, uint *lastButtonState) {
+    int frames = runAheadFrames.load();
+    ((MenuButton *) item)->Text = frames > 0 ? "Run-ahead: " + ToString(frames) + (frames == 1 ? " frame" : " frames") : "Run-ahead: off";
+}
+
+void Emulator::OnClickFastForwardLeft(MenuItem *item) { ChangeFastForwardSpeed((MenuButton *) item, -1); }
 
-        delete[] data;
+void Emulator::OnClickFastForwardRight(MenuItem *item) { ChangeFastForwardSpeed((MenuButton *) item, 1); }
 
-        OVR_LOG("loaded image file: %s", savePath.c_str());
+void Emulator::ChangeFastForwardSpeed(MenuButton *item, int dir) {
+    const int speedCount = sizeof(FastForwardSpeeds) / sizeof(FastForwardSpeeds[0]);
+    int index = (int) (std::find(FastForwardSpeeds, FastForwardSpeeds + speedCount, fastForwardSpeed.load()) - FastForwardSpeeds);
+    if (index >= speedCount)
+        index = 0;
+
+    fastForwardSpeed = FastForwardSpeeds[(index + dir + speedCount) % speedCount];
+    UpdateFastForwardLabel(item, nullptr, nullptr);
+}
 
-        return true;
+// also gets called every frame to show the speed measured during the last fast-forward
+void Emulator::UpdateFastForwardLabel(MenuItem *item, uint *buttonState, uint *lastButtonState) {
+    int speed = fastForwardSpeed.load();
+    std::string text = "Fast-forward: " + (speed > 0 ? ToString(speed) + "x" : std::string("uncapped"));
+    if (measuredSpeed > 0) {
+        char measured[32];
+        snprintf(measured, sizeof(measured), " (last %.1fx)", measuredSpeed);
+        text += measured;
     }
+    ((MenuButton *) item)->Text = text;
+}
+
+void Emulator::OnClickRewindBudgetLeft(MenuItem *item) { ChangeRewindBudget((MenuButton *) item, -1); }
+
+void Emulator::OnClickRewindBudgetRight(MenuItem *item) { ChangeRewindBudget((MenuButton *) item, 1); }
+
+// a different budget drops the rewind history
+void Emulator::ChangeRewindBudget(MenuButton *item, int dir) {
+    const int budgetCount = sizeof(RewindBudgets) / sizeof(RewindBudgets[0]);
+    int index = (int) (std::find(RewindBudgets, RewindBudgets + budgetCount, rewindBudget) - RewindBudgets);
+    if (index >= budgetCount)
+        index = 0;
 
-    OVR_LOG("could not load image file: %s", savePath.c_str());
-    return false;
+    rewindBudget = RewindBudgets[(index + dir + budgetCount) % budgetCount];
+    rewindBudgetBytes = (size_t) rewindBudget * 1024 * 1024;
+    UpdateRewindBudgetLabel(item, nullptr, nullptr);
 }
 
-void Emulator::LoadGame(Rom *rom) {
-    // save the ram of the old rom
-    SaveRam();
+// also gets called every frame so the label follows the loaded settings
+void Emulator::UpdateRewindBudgetLabel(MenuItem *item, uint *buttonState, uint *lastButtonState) {
+    ((MenuButton *) item)->Text = "Rewind memory: " + ToString(rewindBudget) + " MB";
+}
 
-    OVR_LOG("LOAD VRVB ROM %s", rom->FullPath.c_str());
-    std::ifstream file(rom->FullPath, std::ios::in | std::ios::binary | std::ios::ate);
-    if (file.is_open()) {
-        long romBufferSize = file.tellg();
-        char *memblock = new char[romBufferSize];
+// writes the timeline of the last few seconds for chrome://tracing
+void Emulator::OnClickSaveTrace(MenuItem *item) {
+    std::string json;
+    TraceRecorder::Dump(json);
 
-        file.seekg(0, std::ios::beg);
-        file.read(memblock, romBufferSize);
-        file.close();
+    std::vector<uint8_t> *traceBuffer = saveWriter.AcquireBuffer();
+    traceBuffer->assign(json.begin(), json.end());
+    saveWriter.Write(traceFilePath, traceBuffer, TraceSaveTag);
+    ((MenuButton *) item)->Text = "Saving trace...";
+}
 
-        VRVB::LoadRom((const uint8_t *) memblock, (size_t) romBufferSize);
+// the movie starts from the current state of the game
+void Emulator::OnClickRecordMovie(MenuItem *item) {
+    std::lock_guard<std::mutex> lock(coreMutex);
+    if (movieMode.load() == MovieRecording) {
+        StopMovie();
+        return;
+    }
+    if (CurrentRom == nullptr)
+        return;
 
-        delete[] memblock;
+    StopMovie();
+    std::vector<uint8_t> state(VRVB::retro_serialize_size());
+    if (state.empty() || !VRVB::retro_serialize(state.data(), state.size())) {
+        OVR_LOG("movie: failed to save the start state");
+        return;
+    }
+
+    movie.StartRecording(romCrc, state.data(), state.size());
+    movieMode = MovieRecording;
+    OVR_LOG("movie: recording");
+}
 
-        CurrentRom = rom;
-        OVR_LOG("finished loading rom %ld", romBufferSize);
+void Emulator::OnClickPlayMovie(MenuItem *item) {
+    if (movieMode.load() == MoviePlaying) {
+        std::lock_guard<std::mutex> lock(coreMutex);
+        StopMovie();
+        return;
+    }
+    if (CurrentRom == nullptr)
+        return;
+
+    // a movie that just got recorded could still be getting written
+    saveWriter.Flush();
+
+    std::lock_guard<std::mutex> lock(coreMutex);
+    StopMovie();
+
+    MappedFile movieFile;
+    if (!movieFile.Open(MoviePath()) || !movie.Load(movieFile.Data(), movieFile.Size(), romCrc, VRVB::retro_serialize_size())) {
+        OVR_LOG("movie: could not load %s", MoviePath().c_str());
+        return;
+    }
+
+    // playing from power on would replace the sram of the player; those movies are for the headless runner
+    if (movie.PowerOn()) {
+        OVR_LOG("movie: starts from power on, only the headless runner can play it");
+        return;
+    }
+
+    VRVB::retro_unserialize(movie.StartState().data(), movie.StartState().size());
+    rewindBuffer.Clear();
+    movieMode = MoviePlaying;
+    OVR_LOG("movie: playing %u frames", movie.FrameCount());
+}
+
+// needs to hold coreMutex; a recorded movie gets written in the background
+void Emulator::StopMovie() {
+    int mode = movieMode.exchange(MovieIdle);
+    if (mode == MoviePlaying)
+        OVR_LOG("movie: stopped after %u of %u frames", movie.PlayedFrames(), movie.FrameCount());
+
+    if (mode != MovieRecording || CurrentRom == nullptr)
+        return;
+
+    OVR_LOG("movie: recorded %u frames", movie.FrameCount());
+    std::vector<uint8_t> *movieBuffer = saveWriter.AcquireBuffer();
+    movie.Serialize(*movieBuffer);
+    saveWriter.Write(MoviePath(), movieBuffer, MovieSaveTag, InputMovie::Write);
+}
+
+std::string Emulator::MoviePath() {
+    return stateFolderPath + CurrentRom->RomName + ".movie";
+}
+
+// updates both movie buttons
+void Emulator::UpdateMovieLabels(MenuItem *item, uint *buttonState, uint *lastButtonState) {
+    int mode = movieMode.load();
+    recordMovieButton->Text = mode == MovieRecording ? "Stop recording" : "Record movie";
+    playMovieButton->Text = mode == MoviePlaying ? "Stop movie" : "Play movie";
+}
+
+void Emulator::SetDisplayRefreshRate(float refreshRate) {
+    OVR_LOG("frame pacing for %f Hz, judder %f ms", refreshRate, FramePacer::JudderScore(refreshRate, emulationSpeed) * 1000);
+    framePacer.SetDisplayRate(refreshRate);
+}
+
+void Emulator::LoadGame(Rom *rom) {
+    {
+        std::lock_guard<std::mutex> lock(coreMutex);
+        StopMovie();
+    }
+
+    // save the ram of the old rom
+    SaveRam();
+
+    // finish the state writes of the old rom; their results get ignored
+    saveWriter.Flush();
+    saveGeneration++;
+
+    std::lock_guard<std::mutex> lock(coreMutex);
+    OVR_LOG("LOAD VRVB ROM %s", rom->FullPath.c_str());
+    // the core copies the rom out of the mapped file
+    MappedFile romFile;
+    bool romLoaded = romFile.Open(rom->FullPath);
+    if (romLoaded) {
+        VRVB::LoadRom(romFile.Data(), romFile.Size());
+        romCrc = StateFile::Crc32(0, romFile.Data(), romFile.Size());
+        rewindBuffer.Clear();
+
+        // the rom list can get replaced while the game is running
+        loadedRom = *rom;
+        CurrentRom = &loadedRom;
+        OVR_LOG("finished loading rom %zu", romFile.Size());
 
         OVR_LOG("start loading ram");
         LoadRam();
         OVR_LOG("finished loading ram");
+
+        // only changes made by the game get written
+        flushedRam.assign((const uint8_t *) VRVB::save_ram(), (const uint8_t *) VRVB::save_ram() + VRVB::save_ram_size());
+        lastRamFlush = std::chrono::steady_clock::now();
     } else {
         OVR_LOG("could not load VB rom file");
     }
 
-    for (int i = 0; i < 10; ++i) {
-        if (!LoadStateImage(i)) {
-            currentGame->saveStates[i].hasImage = false;
-
-            // clear memory
-            memset(currentGame->saveStates[i].saveImage, 0, sizeof(uint8_t) * VIDEO_WIDTH * 2 * VIDEO_HEIGHT);
-        } else {
-            currentGame->saveStates[i].hasImage = true;
-        }
+    // all slots of the rom are in one file; the images get loaded when they are shown
+    slotContainer.Open(stateFolderPath + rom->RomName + ".states");
+    // older versions saved every slot in its own files
+    if (romLoaded)
+        slotContainer.ImportLegacySlots(stateFolderPath + rom->RomName, romCrc, VRVB::retro_serialize_size(), VIDEO_WIDTH * VIDEO_HEIGHT);
+    thumbnailCache.Clear();
 
-        currentGame->saveStates[i].hasState = StateExists(i);
+    for (int i = 0; i < 10; ++i) {
+        currentGame->saveStates[i].hasImage = slotContainer.HasImage(i);
+        currentGame->saveStates[i].hasState = slotContainer.HasState(i);
+        currentGame->saveStates[i].pendingWrites = 0;
+        currentGame->saveStates[i].writeFailed = false;
     }
 
+    shownImageSlot = -1;
+    shownImageEmpty = false;
     UpdateStateImage(0);
 
     OVR_LOG("LOADED VRVB ROM");
@@ -442,8 +975,8 @@ void Emulator::InitMainMenu(int posX, int posY, Menu &mainMenu) {
 
     int offsetY = 30;
 
-    std::shared_ptr<MenuLabel> labelEmptySlot, labelNoImage;
-    std::shared_ptr<MenuImage> imageSlot, imageSlotBackground;
+    std::shared_ptr<MenuLabel> labelEmptySlot, labelNoImage, labelSaveStatus;
+    std::shared_ptr<MenuImage> imageSlotBackground;
 
     // main menu
     imageSlotBackground = std::make_unique<MenuImage>(ovrVirtualBoyGo::global.textureWhiteId, MENU_WIDTH - VIDEO_WIDTH - 20 - 5,
@@ -458,14 +991,20 @@ void Emulator::InitMainMenu(int posX, int posY, Menu &mainMenu) {
                                                VIDEO_HEIGHT, ovrVector4f{1.0f, 1.0f, 1.0f, 1.0f});
     labelNoImage->UpdateFunction = std::bind(&Emulator::UpdateNoImageSlotLabel, this, _1, _2, _3);
 
+    labelSaveStatus = std::make_unique<MenuLabel>(&ovrVirtualBoyGo::global.fontSlot, "", MENU_WIDTH - VIDEO_WIDTH - 20, HEADER_HEIGHT + offsetY + VIDEO_HEIGHT + 10,
+                                                  VIDEO_WIDTH, 30, ovrVector4f{1.0f, 1.0f, 1.0f, 1.0f});
+    labelSaveStatus->UpdateFunction = std::bind(&Emulator::UpdateSaveStatusLabel, this, _1, _2, _3);
+
     // image slot
     imageSlot = std::make_unique<MenuImage>(stateImageId, MENU_WIDTH - VIDEO_WIDTH - 20, HEADER_HEIGHT + offsetY, VIDEO_WIDTH, VIDEO_HEIGHT,
-                                            ovrVector4f{1.0f, 1.0f, 1.0f, 1.0f});
+                                            ovrVector4f{color[0], color[1], color[2], 1.0f});
+    imageSlot->UpdateFunction = std::bind(&Emulator::UpdateSlotImage, this, _1, _2, _3);
 
     mainMenu.MenuItems.push_back(imageSlotBackground);
     mainMenu.MenuItems.push_back(labelEmptySlot);
     mainMenu.MenuItems.push_back(labelNoImage);
     mainMenu.MenuItems.push_back(imageSlot);
+    mainMenu.MenuItems.push_back(labelSaveStatus);
 }
 
 void Emulator::ChangeOffset(MenuButton *item, float dir) {
@@ -495,12 +1034,6 @@ void Emulator::ChangePalette(MenuButton *item, float dir) {
     ChangeColor(bButton.get(), 2, 0);
 
     item->Text = "Color Palette: " + ToString(selectedPredefColor);
-
-    // update screen
-    if (currentScreenData)
-        UpdateScreen(currentScreenData);
-    // update save slot color
-    UpdateStateImage(ovrVirtualBoyGo::global.saveSlot);
 }
 
 void Emulator::SetThreeDeeMode(MenuItem *item, bool newMode) {
@@ -526,6 +1059,10 @@ void Emulator::OnClickOffsetLeft(MenuItem *item) { ChangeOffset((MenuButton *) i
 
 void Emulator::OnClickOffsetRight(MenuItem *item) { ChangeOffset((MenuButton *) item, IPD_STEP_SIZE); }
 
+void Emulator::OnClickRunAheadLeft(MenuItem *item) { ChangeRunAhead((MenuButton *) item, -1); }
+
+void Emulator::OnClickRunAheadRight(MenuItem *item) { ChangeRunAhead((MenuButton *) item, 1); }
+
 void Emulator::OnClickResetOffset(MenuItem *item) {
     threedeeIPD = 0;
     ChangeOffset((MenuButton *) item, 0);
@@ -545,6 +1082,11 @@ void Emulator::SaveEmulatorSettings(std::ofstream *saveFile) {
     saveFile->write(reinterpret_cast<const char *>(&selectedPredefColor), sizeof(int));
     saveFile->write(reinterpret_cast<const char *>(&threedeeIPD), sizeof(float));
     saveFile->write(reinterpret_cast<const char *>(&useThreeDeeMode), sizeof(bool));
+    int aheadFrames = runAheadFrames.load();
+    saveFile->write(reinterpret_cast<const char *>(&aheadFrames), sizeof(int));
+    int speed = fastForwardSpeed.load();
+    saveFile->write(reinterpret_cast<const char *>(&speed), sizeof(int));
+    saveFile->write(reinterpret_cast<const char *>(&rewindBudget), sizeof(int));
 
     // save button mapping
     for (int i = 0; i < buttonCount; ++i) {
@@ -566,6 +1108,18 @@ void Emulator::LoadEmulatorSettings(std::ifstream *readFile) {
     readFile->read((char *) &selectedPredefColor, sizeof(int));
     readFile->read((char *) &threedeeIPD, sizeof(float));
     readFile->read((char *) &useThreeDeeMode, sizeof(bool));
+    int aheadFrames = 0;
+    readFile->read((char *) &aheadFrames, sizeof(int));
+    runAheadFrames = (aheadFrames >= 0 && aheadFrames <= MaxRunAheadFrames) ? aheadFrames : 0;
+    int speed = 0;
+    readFile->read((char *) &speed, sizeof(int));
+    bool validSpeed = std::find(std::begin(FastForwardSpeeds), std::end(FastForwardSpeeds), speed) != std::end(FastForwardSpeeds);
+    fastForwardSpeed = validSpeed ? speed : 4;
+    int budget = 0;
+    readFile->read((char *) &budget, sizeof(int));
+    bool validBudget = std::find(std::begin(RewindBudgets), std::end(RewindBudgets), budget) != std::end(RewindBudgets);
+    rewindBudget = validBudget ? budget : DefaultRewindBudget;
+    rewindBudgetBytes = (size_t) rewindBudget * 1024 * 1024;
 
     // load button mapping
     for (int i = 0; i < buttonCount; ++i) {
@@ -587,20 +1141,58 @@ void Emulator::LoadEmulatorSettings(std::ifstream *readFile) {
 
 void Emulator::AddRom(const std::string &strFullPath, const std::string &strFilename) {
     size_t lastIndex = strFilename.find_last_of(".");
-    std::string listName = strFilename.substr(0, lastIndex);
-    size_t lastIndexSave = (strFullPath).find_last_of(".");
-    std::string listNameSave = strFullPath.substr(0, lastIndexSave);
+    Rom newRom = CreateRom(strFullPath, strFilename.substr(0, lastIndex));
+
+    romFileList.push_back(newRom);
+
+    OVR_LOG("add rom: %s %s %s", newRom.RomName.c_str(), newRom.FullPath.c_str(),
+            newRom.SavePath.c_str());
+}
+
+Emulator::Rom Emulator::CreateRom(const std::string &fullPath, const std::string &romName) {
+    size_t lastIndexSave = fullPath.find_last_of(".");
+    std::string listNameSave = fullPath.substr(0, lastIndexSave);
 
     Rom newRom;
-    newRom.RomName = listName;
-    newRom.FullPath = strFullPath;
+    newRom.RomName = romName;
+    newRom.FullPath = fullPath;
     newRom.FullPathNorm = listNameSave;
     newRom.SavePath = listNameSave + ".srm";
+    return newRom;
+}
 
-    romFileList.push_back(newRom);
+// can be called from any thread
+void Emulator::ScanRoms() {
+    romCatalog.Scan();
+}
 
-    OVR_LOG("add rom: %s %s %s", newRom.RomName.c_str(), newRom.FullPath.c_str(),
-            newRom.SavePath.c_str());
+// takes over the list of the last catalog scan; needs to be called on the app thread
+void Emulator::UpdateRomList() {
+    std::shared_ptr<const RomCatalog::EntryList> list = romCatalog.TakeUpdate();
+    if (list)
+        SetRomList(*list);
+}
+
+// the selection stays on the same rom if it is still in the list
+void Emulator::SetRomList(const RomCatalog::EntryList &list) {
+    std::string selectedPath;
+    if (romList && romList->CurrentSelection >= 0 && romList->CurrentSelection < (int) romFileList.size())
+        selectedPath = romFileList[romList->CurrentSelection].FullPath;
+
+    romFileList.clear();
+    romFileList.reserve(list.size());
+    for (const RomCatalog::Entry &entry : list)
+        romFileList.push_back(CreateRom(entry.path, entry.name));
+    OVR_LOG("rom list has %zu roms", romFileList.size());
+
+    if (!romList)
+        return;
+
+    int selection = selectedPath.empty() ? romSelection : 0;
+    for (size_t i = 0; i < romFileList.size(); ++i)
+        if (romFileList[i].FullPath == selectedPath)
+            selection = (int) i;
+    romList->CurrentSelection = (selection >= 0 && selection < (int) romFileList.size()) ? selection : 0;
 }
 
 // sort the roms by name
@@ -615,96 +1207,180 @@ void Emulator::SortRomList() {
 }
 
 void Emulator::ResetGame() {
+    std::lock_guard<std::mutex> lock(coreMutex);
+    StopMovie();
     VRVB::Reset();
+    rewindBuffer.Clear();
 }
 
 void Emulator::SaveRam() {
-    if (CurrentRom != nullptr && VRVB::save_ram_size() > 0) {
-        OVR_LOG("save ram %i", (int) VRVB::save_ram_size());
-        std::ofstream outfile(CurrentRom->SavePath, std::ios::trunc | std::ios::binary);
-        outfile.write((const char *) VRVB::save_ram(), VRVB::save_ram_size());
-        outfile.close();
-        OVR_LOG("finished writing ram file");
-    }
+    std::lock_guard<std::mutex> lock(coreMutex);
+    FlushRam(true);
+}
+
+// needs to hold coreMutex; the ram only gets written if it changed since the last write
+// without force the writes are limited to one every RamFlushInterval seconds
+void Emulator::FlushRam(bool force) {
+    if (CurrentRom == nullptr || VRVB::save_ram_size() == 0)
+        return;
+
+    size_t size = VRVB::save_ram_size();
+    const uint8_t *ram = (const uint8_t *) VRVB::save_ram();
+    if (flushedRam.size() == size && memcmp(flushedRam.data(), ram, size) == 0)
+        return;
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (!force && std::chrono::duration<double>(now - lastRamFlush).count() < RamFlushInterval)
+        return;
+
+    flushedRam.assign(ram, ram + size);
+    lastRamFlush = now;
+
+    OVR_LOG("save ram %i", (int) size);
+    std::vector<uint8_t> *ramBuffer = saveWriter.AcquireBuffer();
+    ramBuffer->assign(ram, ram + size);
+    saveWriter.Write(CurrentRom->SavePath, ramBuffer, RamSaveTag);
+
+    ramFlushes++;
+    ramBytesWritten += size;
 }
 
 void Emulator::LoadRam() {
-    std::ifstream file(CurrentRom->SavePath, std::ios::in | std::ios::binary | std::ios::ate);
-    if (file.is_open()) {
-        long romBufferSize = file.tellg();
-        char *memblock = new char[romBufferSize];
-        file.seekg(0, std::ios::beg);
-        file.read(memblock, romBufferSize);
-        file.close();
-        OVR_LOG("loaded ram %ld", romBufferSize);
+    MappedFile ramFile;
+    if (ramFile.Open(CurrentRom->SavePath)) {
+        OVR_LOG("loaded ram %zu", ramFile.Size());
 
         OVR_LOG("ram size %i", (int) VRVB::save_ram_size());
 
-        if (romBufferSize != (int) VRVB::save_ram_size()) {
+        if (ramFile.Size() != VRVB::save_ram_size()) {
             OVR_LOG("ERROR loaded ram size is wrong");
         } else {
-            memcpy(VRVB::save_ram(), memblock, VRVB::save_ram_size());
+            memcpy(VRVB::save_ram(), ramFile.Data(), VRVB::save_ram_size());
             OVR_LOG("finished loading ram");
         }
-
-        delete[] memblock;
     } else {
         OVR_LOG("could not load ram file: %s", CurrentRom->SavePath.c_str());
     }
 }
 
+// the slot gets written by the save writer; hasState and hasImage are set once it is on the disk
 void Emulator::SaveState(int slot) {
-    // get the size of the savestate
-    size_t size = VRVB::retro_serialize_size();
+    slot = ovrVirtualBoyGo::global.saveSlot;
 
-    if (size > 0) {
-        std::string savePath = stateFolderPath + CurrentRom->RomName + ".state";
-        if (ovrVirtualBoyGo::global.saveSlot > 0) savePath += ToString(ovrVirtualBoyGo::global.saveSlot);
-
-        OVR_LOG("save slot");
-        void *data = new uint8_t[size];
-        VRVB::retro_serialize(data, size);
+    // the buffer holds the state followed by the image
+    std::vector<uint8_t> *slotBuffer = saveWriter.AcquireBuffer();
+    size_t stateSize = 0;
+    bool serialized = false;
+    {
+        std::lock_guard<std::mutex> lock(coreMutex);
+        // get the size of the savestate
+        stateSize = VRVB::retro_serialize_size();
+        if (stateSize > 0) {
+            slotBuffer->resize(stateSize + VIDEO_WIDTH * VIDEO_HEIGHT);
+            serialized = VRVB::retro_serialize(slotBuffer->data(), stateSize);
+        }
+        // the image is the left eye of the last frame; the mailbox buffers could be write only memory
+        if (serialized)
+            memcpy(slotBuffer->data() + stateSize, videoFrame.data(), sizeof(uint8_t) * VIDEO_WIDTH * VIDEO_HEIGHT);
+    }
 
-        OVR_LOG("save slot to %s", savePath.c_str());
-        std::ofstream outfile(savePath, std::ios::trunc | std::ios::binary);
-        outfile.write((const char *) data, size);
-        outfile.close();
-        OVR_LOG("finished writing slot to file");
+    if (!serialized) {
+        OVR_LOG("could not serialize the state");
+        saveWriter.ReleaseBuffer(slotBuffer);
+        currentGame->saveStates[slot].writeFailed = true;
+        return;
     }
 
     OVR_LOG("copy image");
-    memcpy(currentGame->saveStates[ovrVirtualBoyGo::global.saveSlot].saveImage, screenData,
-           sizeof(uint8_t) * VIDEO_WIDTH * VIDEO_HEIGHT);
+    thumbnailCache.Put(slot, slotBuffer->data() + stateSize);
     OVR_LOG("update image");
-    UpdateStateImage(ovrVirtualBoyGo::global.saveSlot);
-    // save image for the slot
-    SaveStateImage(ovrVirtualBoyGo::global.saveSlot);
-    currentGame->saveStates[ovrVirtualBoyGo::global.saveSlot].hasImage = true;
-    currentGame->saveStates[ovrVirtualBoyGo::global.saveSlot].hasState = true;
+    UpdateStateImage(slot);
+
+    OVR_LOG("save slot %i", slot);
+    uint32_t crc = romCrc;
+    saveWriter.Queue(CurrentRom->RomName + ".states", slotBuffer, (saveGeneration << 8) | slot,
+                     [this, slot, stateSize, crc](const std::vector<uint8_t> &data) {
+                         return slotContainer.WriteSlot(slot, data.data(), stateSize, crc, data.data() + stateSize, data.size() - stateSize);
+                     });
+
+    currentGame->saveStates[slot].pendingWrites++;
+    currentGame->saveStates[slot].writeFailed = false;
 }
 
-void Emulator::LoadState(int slot) {
-    std::string savePath = stateFolderPath + CurrentRom->RomName + ".state";
-    if (slot > 0) savePath += ToString(slot);
+// applies the finished writes of the save writer to the slots
+void Emulator::UpdateSaveResults() {
+    SaveWriter::Result result;
+    while (saveWriter.PopResult(result)) {
+        if (result.tag == TraceSaveTag) {
+            OVR_LOG(result.success ? "saved trace to %s" : "failed to save trace to %s", result.path.c_str());
+            traceButton->Text = result.success ? "Trace saved" : "Saving trace failed";
+            continue;
+        }
 
-    std::ifstream file(savePath, std::ios::in | std::ios::binary | std::ios::ate);
-    if (file.is_open()) {
-        long size = file.tellg();
-        char *data = new char[size];
+        if (result.tag == MovieSaveTag) {
+            OVR_LOG(result.success ? "movie: saved %s" : "movie: failed to save %s", result.path.c_str());
+            continue;
+        }
 
-        file.seekg(0, std::ios::beg);
-        file.read(data, size);
-        file.close();
-        OVR_LOG("loaded slot has size: %ld", size);
+        if (result.tag == RamSaveTag) {
+            if (!result.success) {
+                OVR_LOG("failed to write the ram to %s", result.path.c_str());
+                // forget the written copy so the next check tries again
+                std::lock_guard<std::mutex> lock(coreMutex);
+                flushedRam.clear();
+            }
+            continue;
+        }
 
-        VRVB::retro_unserialize(data, size);
+        // the write was for a game that is not loaded anymore
+        if ((result.tag >> 8) != saveGeneration)
+            continue;
 
-        delete[] data;
-    } else {
-        OVR_LOG("could not load ram file: %s", CurrentRom->SavePath.c_str());
+        struct SaveState &state = currentGame->saveStates[result.tag & 0xFF];
+        state.pendingWrites--;
+
+        if (!result.success) {
+            OVR_LOG("failed to write %s", result.path.c_str());
+            state.writeFailed = true;
+        } else {
+            state.hasState = true;
+            state.hasImage = true;
+        }
     }
 }
 
+void Emulator::UpdateSaveStatusLabel(MenuItem *item, uint *buttonState, uint *lastButtonState) {
+    UpdateSaveResults();
+
+    struct SaveState &state = currentGame->saveStates[ovrVirtualBoyGo::global.saveSlot];
+    item->Visible = state.pendingWrites > 0 || state.writeFailed;
+    ((MenuLabel *) item)->Text = state.writeFailed ? "- Save failed -" : "- Saving -";
+}
+
+void Emulator::LoadState(int slot) {
+    // the slot could still be getting written
+    saveWriter.Flush();
+
+    size_t stateSize;
+    {
+        std::lock_guard<std::mutex> lock(coreMutex);
+        stateSize = VRVB::retro_serialize_size();
+    }
+
+    // the file gets checked before the core sees it
+    std::vector<uint8_t> state;
+    if (!slotContainer.ReadState(slot, romCrc, stateSize, state)) {
+        OVR_LOG("could not load slot %i", slot);
+        return;
+    }
+    OVR_LOG("loaded slot has size: %zu", state.size());
+
+    std::lock_guard<std::mutex> lock(coreMutex);
+    StopMovie();
+    VRVB::retro_unserialize(state.data(), state.size());
+    rewindBuffer.Clear();
+}
+
 void Emulator::ResetButtonMapping() {
     for (int i = 0; i < buttonCount; ++i) {
         buttonMapping[i].Buttons[0].InputDevice = ButtonMapper::DeviceGamepad;
@@ -757,25 +1433,117 @@ void Emulator::ResetButtonMapping() {
     buttonMapping[12].Buttons[1].ButtonIndex = ButtonMapper::EmuButton_Left;
     buttonMapping[13].Buttons[1].InputDevice = ButtonMapper::DeviceRightTouch;
     buttonMapping[13].Buttons[1].ButtonIndex = ButtonMapper::EmuButton_Down;
+
+    // rewind is not mapped by default
+    buttonMapping[rewindButton].Buttons[0].ButtonIndex = ButtonMapper::EmuButton_A;
+    buttonMapping[rewindButton].Buttons[0].IsSet = false;
+    buttonMapping[rewindButton].Buttons[1].InputDevice = ButtonMapper::DeviceRightTouch;
+    buttonMapping[rewindButton].Buttons[1].ButtonIndex = ButtonMapper::EmuButton_A;
+    buttonMapping[rewindButton].Buttons[1].IsSet = false;
+
+    // fast-forward is not mapped by default either
+    buttonMapping[fastForwardButton].Buttons[0].ButtonIndex = ButtonMapper::EmuButton_A;
+    buttonMapping[fastForwardButton].Buttons[0].IsSet = false;
+    buttonMapping[fastForwardButton].Buttons[1].InputDevice = ButtonMapper::DeviceRightTouch;
+    buttonMapping[fastForwardButton].Buttons[1].ButtonIndex = ButtonMapper::EmuButton_A;
+    buttonMapping[fastForwardButton].Buttons[1].IsSet = false;
 }
 
+// one entry per set binding with the mask already looked up; bindings of the same device and mask are merged
+void Emulator::CompileButtonMapping() {
+    memcpy(compiledMapping, buttonMapping, sizeof(buttonMapping));
+    compiledBindings.clear();
+
+    for (int i = 0; i < buttonCount; ++i) {
+        for (int x = 0; x < 2; ++x) {
+            const ButtonMapper::MappedButton &button = buttonMapping[i].Buttons[x];
+            if (!button.IsSet)
+                continue;
+
+            CompiledBinding binding = {button.InputDevice, ButtonMapper::ButtonMapping[button.ButtonIndex], 1u << i};
+            auto existing = std::find_if(compiledBindings.begin(), compiledBindings.end(), [&binding](const CompiledBinding &other) {
+                return other.device == binding.device && other.mask == binding.mask;
+            });
+            if (existing != compiledBindings.end())
+                existing->bits |= binding.bits;
+            else
+                compiledBindings.push_back(binding);
+        }
+    }
+}
+
+// the core runs on the emulation thread; this only hands over the input and keeps the game running
 void Emulator::Update(const OVRFW::ovrApplFrameIn &in, uint *buttonState, uint *lastButtonState) {
-    // methode will only get called "emulationSpeed" times a second
-    frameCounter += in.DeltaSeconds;
-    if (frameCounter < 1 / emulationSpeed) {
-        return;
+    TraceRecorder::Scope trace("Update");
+    uint32_t input = 0;
+
+    {
+        TraceRecorder::Scope traceInput("InputMapping");
+        // the menu changes buttonMapping directly so the table gets rebuilt when it differs from the compiled copy
+        if (memcmp(compiledMapping, buttonMapping, sizeof(buttonMapping)) != 0)
+            CompileButtonMapping();
+
+        for (const CompiledBinding &binding : compiledBindings)
+            if (buttonState[binding.device] & binding.mask)
+                input |= binding.bits;
+    }
+
+    // the latency gets measured from the first frame a change was seen to the frame that runs with it
+    uint16_t vbInput = (uint16_t) (input & ((1 << vbButtonCount) - 1));
+    if (vbInput != lastMappedInput) {
+        lastMappedInput = vbInput;
+        inputChangeTime.store(std::chrono::steady_clock::now().time_since_epoch().count());
     }
-    frameCounter -= 1 / emulationSpeed;
+    inputState.store(vbInput);
 
-    // TODO
-    VRVB::input_buf[0] = 0;
+    UpdateSaveResults();
 
-    for (int i = 0; i < buttonCount; ++i)
-        for (int x = 0; x < 2; ++x)
-            VRVB::input_buf[0] |= (buttonMapping[i].Buttons[x].IsSet && (buttonState[buttonMapping[i].Buttons[x].InputDevice] &
-                                                                         ButtonMapper::ButtonMapping[buttonMapping[i].Buttons[x].ButtonIndex])) ? (1 << i) : 0;
+    // the rewind history only takes memory while rewind is mapped
+    rewindEnabled = buttonMapping[rewindButton].Buttons[0].IsSet || buttonMapping[rewindButton].Buttons[1].IsSet;
+    rewindHeld = rewindEnabled && (input & (1 << rewindButton));
 
-    VRVB::Run();
+    // samples that are cut short by letting go or that span a pause (menu) are not counted
+    bool fastForward = (input & (1 << fastForwardButton)) != 0;
+    double sampleTime = in.PredictedDisplayTime - speedSampleTime;
+    if (fastForward != fastForwardHeld.load() || sampleTime >= SpeedSampleTime) {
+        if (fastForwardHeld.load() && sampleTime >= SpeedSampleTime && sampleTime < SpeedSampleTime * 2)
+            measuredSpeed = (float) ((coreFrames.load() - speedSampleFrames) / (sampleTime * emulationSpeed));
+        if (!fastForward && fastForwardHeld.load())
+            OVR_LOG("fast-forward: measured %.1fx", measuredSpeed);
+
+        speedSampleTime = in.PredictedDisplayTime;
+        speedSampleFrames = coreFrames.load();
+    }
+    fastForwardHeld = fastForward;
+
+    // schedule the emulated frames by the time the frames will be displayed
+    uint64_t target = framePacer.Schedule(in.PredictedDisplayTime, emulatedFrames.load());
+    {
+        std::lock_guard<std::mutex> lock(scheduleMutex);
+        targetFrame = target;
+    }
+    scheduleCondition.notify_one();
+
+    if (in.PredictedDisplayTime - lastPacingReport > 10) {
+        lastPacingReport = in.PredictedDisplayTime;
+        OVR_LOG("frame pacing: presented %llu, dropped %llu, duplicated %llu, caught up %llu without video, skipped %llu",
+                (unsigned long long) framePacer.PresentedFrames(), (unsigned long long) framePacer.DroppedFrames(),
+                (unsigned long long) framePacer.DuplicatedFrames(), (unsigned long long) catchUpFrames.load(),
+                (unsigned long long) framePacer.SkippedFrames());
+        OVR_LOG("audio buffer: fill %u/%u, underruns %llu, overruns %llu, ratio %f", audioOutput->Buffer().FillLevel(), audioOutput->Buffer().TargetFrames(),
+                (unsigned long long) audioOutput->Buffer().Underruns(), (unsigned long long) audioOutput->Buffer().Overruns(), audioResampler.Ratio());
+        OVR_LOG("screen: %llu frames, %llu unchanged, %llu unchanged eyes, %.1f%% of the bands uploaded", (unsigned long long) screenFrames,
+                (unsigned long long) unchangedFrames, (unsigned long long) unchangedEyes,
+                screenFrames > 0 ? uploadedBands * 100.0 / (screenFrames * 2 * ScreenBands) : 0.0);
+        if (inputLatency.Count() > 0) {
+            OVR_LOG("input latency: %llu changes, p50 %.1fms, p90 %.1fms, p99 %.1fms, max %.1fms", (unsigned long long) inputLatency.Count(),
+                    inputLatency.Percentile(0.5) * 1000, inputLatency.Percentile(0.9) * 1000, inputLatency.Percentile(0.99) * 1000, inputLatency.Max() * 1000);
+            OVR_LOG("input latency histogram (ms:count): %s", inputLatency.ToString().c_str());
+        }
+        OVR_LOG("sram: %llu writes, %llu bytes", (unsigned long long) ramFlushes.load(), (unsigned long long) ramBytesWritten.load());
+        if (rewindEnabled)
+            OVR_LOG("rewind: %zu states, %zu bytes", rewindBuffer.StateCount(), rewindBuffer.UsedBytes());
+    }
 }
 
 // Aspect is width / height
@@ -807,41 +1575,80 @@ Matrix4f BoundsScreenMatrix(const Bounds3f &bounds, const float movieAspect) {
            Matrix4f::Scaling(widthScale, heightScale, 1.0f);
 }
 
-void Emulator::UpdateScreen(const void *data) {
+// the right eye starts below the left one after the gap rows
+size_t Emulator::ScreenBandOffset(int eye, int band) {
+    return ((size_t) eye * (VIDEO_HEIGHT + screenborder * 2) + band * ScreenBandRows) * VIDEO_WIDTH;
+}
+
+// data is a frame from the mailbox; the color gets applied in DrawScreen
+// only the row bands set in dirtyBands get uploaded; nothing gets drawn if the frame did not change
+// the frame is never read here because the mailbox buffers can be write only pixel buffers
+void Emulator::UpdateScreen(const void *data, uint32_t dirtyBands) {
+    TraceRecorder::Scope trace("UpdateScreen");
+    currentScreenData = data;
     screenData = (uint8_t *) data;
-    uint8_t *dataArray = (uint8_t *) data;
 
-    for (int y = 0; y < VIDEO_HEIGHT; ++y) {
-        for (int x = 0; x < VIDEO_WIDTH; ++x) {
-            uint8_t das = dataArray[x + y * VIDEO_WIDTH];
-            pixelData[x + y * VIDEO_WIDTH] =
-                    0xFF000000 | ((int) (das * color[2]) << 16) | ((int) (das * color[1]) << 8) | (int) (das * color[0]);
-        }
+    int dirtyCount = 0;
+    for (int eye = 0; eye < 2; ++eye) {
+        int eyeDirtyCount = 0;
+        for (int band = 0; band < ScreenBands; ++band)
+            eyeDirtyCount += (dirtyBands >> (eye * ScreenBands + band)) & 1;
+        if (eyeDirtyCount == 0)
+            unchangedEyes++;
+        dirtyCount += eyeDirtyCount;
     }
 
-    for (int y = 0; y < VIDEO_HEIGHT; ++y) {
-        for (int x = 0; x < VIDEO_WIDTH; ++x) {
-            uint8_t das = dataArray[x + (y + VIDEO_HEIGHT + 12) * VIDEO_WIDTH];
-            pixelData[x + (y + VIDEO_HEIGHT + screenborder * 2) * VIDEO_WIDTH] =
-                    0xFF000000 | ((int) (das * color[2]) << 16) | ((int) (das * color[1]) << 8) | (int) (das * color[0]);
-        }
+    screenFrames++;
+    uploadedBands += dirtyCount;
+    if (dirtyCount == 0) {
+        unchangedFrames++;
+        return;
     }
 
-    // make the space between the two images transparent
-    memset(&pixelData[VIDEO_WIDTH * VIDEO_HEIGHT], 0x00000000, screenborder * 1 * VIDEO_WIDTH * 4);
-    memset(&pixelData[VIDEO_WIDTH * VIDEO_HEIGHT + VIDEO_WIDTH], 0x00000000, screenborder * 1 * VIDEO_WIDTH * 4);
+    {
+        TraceRecorder::Scope traceUpload("TextureUpload");
+        // the frame already is in a pixel buffer if they are mapped persistently; otherwise it gets uploaded from client memory
+        bool fromBuffer = screenUpload.Persistent();
+        if (fromBuffer)
+            screenUpload.Bind(frameMailbox.ReadIndex());
+
+        glBindTexture(GL_TEXTURE_2D, screenTextureId);
+        // every run of changed bands gets uploaded with one call
+        for (int eye = 0; eye < 2; ++eye) {
+            for (int band = 0; band < ScreenBands; ++band) {
+                if (!((dirtyBands >> (eye * ScreenBands + band)) & 1))
+                    continue;
+
+                int firstBand = band;
+                while (band + 1 < ScreenBands && ((dirtyBands >> (eye * ScreenBands + band + 1)) & 1))
+                    band++;
+
+                size_t offset = ScreenBandOffset(eye, firstBand);
+                int rows = (band - firstBand + 1) * ScreenBandRows;
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, (int) (offset / VIDEO_WIDTH), VIDEO_WIDTH, rows, GL_RED, GL_UNSIGNED_BYTE,
+                                fromBuffer ? (const void *) offset : screenData + offset);
+            }
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        if (fromBuffer)
+            screenUpload.Submit(frameMailbox.ReadIndex());
+    }
 
-    glBindTexture(GL_TEXTURE_2D, screenTextureId);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, CylinderWidth, TextureHeight, GL_RGBA, GL_UNSIGNED_BYTE, pixelData);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    DrawScreen();
+}
 
+void Emulator::DrawScreen() {
+    TraceRecorder::Scope trace("DrawScreen");
     glDisable(GL_CULL_FACE);
     glDisable(GL_DEPTH_TEST);
     glEnable(GL_BLEND);
     glBlendFuncSeparate(GL_ONE, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE);
     glBlendEquation(GL_FUNC_ADD);
-    // render image to the screen texture
-    glBindFramebuffer(GL_FRAMEBUFFER, screenFramebuffer[0]);
+    // render image into the next image of the swap chain; the layer shows it from now on
+    cylinderImageIndex = (cylinderImageIndex + 1) % (int) screenFramebuffers.size();
+    screenTextureCylinderId = vrapi_GetTextureSwapChainHandle(CylinderSwapChain, cylinderImageIndex);
+    glBindFramebuffer(GL_FRAMEBUFFER, screenFramebuffers[cylinderImageIndex]);
     glViewport(0, 0, VIDEO_WIDTH * 2 + screenborder * 2, TextureHeight * 2 + screenborder * 4);
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
@@ -854,7 +1661,7 @@ void Emulator::UpdateScreen(const void *data) {
                             576 * ((float) screenborder * 2 / (TextureHeight * 2 + screenborder * 4)),
                             640 * ((float) (VIDEO_WIDTH * 2) / (VIDEO_WIDTH * 2 + screenborder * 4)),
                             576 * ((float) (TextureHeight * 2) / (TextureHeight * 2 + screenborder * 4)),
-                            {1.0f, 1.0f, 1.0f, 1.0f}, 1);
+                            {color[0], color[1], color[2], 1.0f}, 1);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
     // TODO whut
@@ -863,11 +1670,30 @@ void Emulator::UpdateScreen(const void *data) {
 }
 
 void Emulator::DrawScreenLayer(ApplInterface &appl, const OVRFW::ovrApplFrameIn &in, OVRFW::ovrRendererOutput &out, const ovrTracking2 &tracking) {
+    TraceRecorder::Scope trace("DrawScreenLayer");
+    // show the newest frame finished by the emulation thread
+    // latching hands the last frame back to the emulation thread; the gpu has to be done uploading from its pixel buffer
+    if (screenUpload.Persistent() && frameMailbox.Pending())
+        screenUpload.Wait(frameMailbox.ReadIndex());
+    bool newFrame = frameMailbox.Latch();
+    if (newFrame) {
+        // the bands are compared with the frame before; if that frame never got latched all bands get uploaded
+        int index = frameMailbox.ReadIndex();
+        uint32_t dirtyBands = AllScreenBands;
+        if (frameSequence[index] == latchedSequence + 1)
+            dirtyBands = frameDirtyBands[index];
+        latchedSequence = frameSequence[index];
+        UpdateScreen(frameMailbox.ReadBuffer(), dirtyBands);
+    }
+    framePacer.Present(newFrame, frameMailbox.ReadFrameNumber());
+
     ovrLayerCylinder2 layer = layerBuilder->BuildGameCylinderLayer3D(
             CylinderSwapChain, CylinderWidth, CylinderHeight, &tracking, ovrVirtualBoyGo::global.followHead,
             !ovrVirtualBoyGo::global.menuOpen && useThreeDeeMode, threedeeIPD, in.IPD);
 
     layer.Header.Flags |= VRAPI_FRAME_LAYER_FLAG_CHROMATIC_ABERRATION_CORRECTION;
+    for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; ++eye)
+        layer.Textures[eye].SwapChainIndex = cylinderImageIndex;
 
     appl.AddLayerCylinder2(layer);
 }
@@ -1,14 +1,32 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 #include <FrontendGo/LayerBuilder.h>
 #include <FrontendGo/Global.h>
-#include <FrontendGo/Audio/OpenSLWrap.h>
 #include <FrontendGo/ApplInterface.h>
 #include "MenuHelper.h"
 #include "ButtonMapping.h"
 #include "Global.h"
+#include "FrameMailbox.h"
+#include "FramePacer.h"
+#include "AudioOutput.h"
+#include "AudioResampler.h"
+#include "RewindBuffer.h"
+#include "SaveWriter.h"
+#include "SlotContainer.h"
+#include "ThumbnailCache.h"
+#include "RomCatalog.h"
+#include "MappedFile.h"
+#include "TraceRecorder.h"
+#include "PixelBufferRing.h"
+#include "LatencyHistogram.h"
+#include "InputMovie.h"
 
 using namespace OVR;
 
@@ -26,7 +44,9 @@ public:
     struct SaveState {
         bool hasImage;
         bool hasState;
-        uint8_t *saveImage;
+        // files of the slot that are queued in the save writer
+        int pendingWrites;
+        bool writeFailed;
     };
 
     struct LoadedGame {
@@ -36,7 +56,7 @@ public:
     LayerBuilder *layerBuilder;
     DrawHelper *drawHelper;
 
-    OpenSLWrapper *openSlWrap;
+    AudioOutput *audioOutput;
 
     std::function<void()> OnRomLoaded;
 
@@ -46,9 +66,13 @@ public:
     const std::string stateFilePath = "/Roms/VB/States/";
     const std::vector<std::string> supportedFileNames = {".vb", ".vboy", ".bin"};
 
-    const static int buttonCount = 14;
+    // the first 14 mappings are the vb buttons, the last two are used to rewind and fast-forward the game
+    const static int buttonCount = 16;
+    const static int vbButtonCount = 14;
+    const static int rewindButton = 14;
+    const static int fastForwardButton = 15;
     ButtonMapper::MappedButtons buttonMapping[buttonCount];
-    int buttonOrder[14] = {0, 1, 3, 2, 11, 10, 7, 6, 9, 8, 12, 5, 4, 13};
+    int buttonOrder[16] = {0, 1, 3, 2, 11, 10, 7, 6, 9, 8, 12, 5, 4, 13, 14, 15};
 
     // menu size
     const int MENU_WIDTH = 640;
@@ -67,13 +91,21 @@ public:
     // maybe this will be supported on future headsets?
     const float DisplayRefreshRate = 50.27f;
 
-    const int SAVE_FILE_VERSION = 27;
+    // audio that gets buffered before playback starts (~46ms)
+    const uint32_t AudioLatencyFrames = 2048;
+    const int CoreSampleRate = 44100;
+
+    // memory used to store the rewind history in MB; can be changed in the settings
+    const int RewindBudgets[5] = {4, 8, 16, 32, 64};
+    const int DefaultRewindBudget = 8;
+
+    const int SAVE_FILE_VERSION = 31;
 
     GLuint *button_icons[buttonCount];
 
     void Free();
 
-    void Init(std::string stateFolder, LayerBuilder *_layerBuilder, DrawHelper *_drawHelper, OpenSLWrapper *openSLWrap);
+    void Init(std::string stateFolder, LayerBuilder *_layerBuilder, DrawHelper *_drawHelper, AudioOutput *_audioOutput);
 
     void ResetGame();
 
@@ -89,15 +121,23 @@ public:
 
     void SortRomList();
 
+    void ScanRoms();
+
+    void UpdateRomList();
+
     void Update(const OVRFW::ovrApplFrameIn &in, uint *buttonStates, uint *lastButtonStates);
 
+    void SetDisplayRefreshRate(float refreshRate);
+
     void DrawScreenLayer(ApplInterface &appl, const OVRFW::ovrApplFrameIn &in, OVRFW::ovrRendererOutput &out, const ovrTracking2 &tracking);
 
     void LoadEmulatorSettings(std::ifstream *file);
 
     void InitSettingsMenu(int &posX, int &posY, Menu &settingsMenu);
 
-    void UpdateScreen(const void *data);
+    void UpdateScreen(const void *data, uint32_t dirtyBands);
+
+    size_t ScreenBandOffset(int eye, int band);
 
     void InitMainMenu(int posX, int posY, Menu &mainMenu);
 
@@ -111,11 +151,22 @@ public:
 
     void InitStateImage();
 
+    GLuint CreateArrowIcon(bool pointRight);
+
     void OnClickRom(Rom *rom);
 
     void InitRomSelectionMenu(int posX, int posY, Menu &romSelectionMenu);
 
 private:
+    // buttonMapping compiled into a list of the device button masks that set each vb button
+    struct CompiledBinding {
+        int device;
+        uint32_t mask;
+        uint32_t bits;
+    };
+
+    ButtonMapper::MappedButtons compiledMapping[buttonCount] = {};
+    std::vector<CompiledBinding> compiledBindings;
 
     ovrVector3f predefColors[11] = {{1.0f,  0.0f,  0.0f},
                                     {0.9f,  0.3f,  0.1f},
@@ -133,10 +184,36 @@ private:
     float color[3]{1.0f, 1.0f, 1.0f};
 
     std::vector<Rom> romFileList;
+    RomCatalog romCatalog;
 
     GLuint screenTextureId, stateImageId;
+    // icons of the rewind and fast-forward mappings; the frontend has no icons for them
+    GLuint rewindIconId = 0, fastForwardIconId = 0;
+    // backs the frame mailbox if the buffers can be mapped persistently; the screen texture gets uploaded from there
+    PixelBufferRing screenUpload;
+    // every eye gets compared in bands of rows and only the changed bands get uploaded
+    // bit eye * ScreenBands + band of a mask is set if the band changed
+    static const int ScreenBandRows = 16;
+    static const int ScreenBands = 224 / ScreenBandRows; // VIDEO_HEIGHT / ScreenBandRows
+    static const uint32_t AllScreenBands = (1u << (ScreenBands * 2)) - 1;
+    // copy of the last frame the core produced in the layout of the screen texture; only touched while holding coreMutex
+    // the frames get compared against it on the emulation thread, so the render thread never reads the mailbox buffers
+    std::vector<uint8_t> videoFrame;
+    uint64_t videoSequence = 0;
+    // changed bands of the frame in every mailbox buffer and its number in the order of the published frames
+    uint32_t frameDirtyBands[FrameMailbox::BufferCount]{};
+    uint64_t frameSequence[FrameMailbox::BufferCount]{};
+    uint64_t latchedSequence = 0;
+    uint64_t screenFrames = 0;
+    uint64_t unchangedFrames = 0;
+    uint64_t unchangedEyes = 0;
+    uint64_t uploadedBands = 0;
     GLuint screenTextureCylinderId;
     ovrTextureSwapChain *CylinderSwapChain;
+    // every new frame gets drawn into the next image of the swap chain so the compositor never reads the image that gets drawn
+    const int CylinderSwapChainLength = 3;
+    std::vector<GLuint> screenFramebuffers;
+    int cylinderImageIndex = 0;
 
     const void *currentScreenData = nullptr;
 
@@ -164,11 +241,105 @@ private:
     LoadedGame *currentGame;
 
     std::string stateFolderPath;
-
-    bool audioInit;
+    std::string traceFilePath;
+
+    // states and images get written on the save writer thread
+    SaveWriter saveWriter;
+    // shared by the save writer and the thumbnail cache threads
+    SlotContainer slotContainer;
+
+    // images of the last shown slots; only one eye gets stored
+    const int ThumbnailCacheSize = 4;
+    ThumbnailCache thumbnailCache;
+    std::vector<uint8_t> slotImage;
+    int shownImageSlot = -1;
+    bool shownImageLoaded = false;
+    bool shownImageEmpty = false;
+    // changes with every loaded game so results of writes for the old game get ignored
+    int saveGeneration = 0;
+    // states are only loaded for the rom they were saved with
+    uint32_t romCrc = 0;
+
+    // the emulation thread compares the sram with the last written copy and writes it when the game changed it
+    const int RamCheckFrames = 50;
+    const double RamFlushInterval = 5.0;
+    static const int RamSaveTag = -1;
+    static const int TraceSaveTag = -2;
+
+    // the emulation thread records or plays the movie; only used while holding coreMutex
+    enum MovieMode { MovieIdle, MovieRecording, MoviePlaying };
+    static const int MovieSaveTag = -3;
+    InputMovie movie;
+    std::atomic<int> movieMode{MovieIdle};
+    std::vector<uint8_t> flushedRam;
+    std::chrono::steady_clock::time_point lastRamFlush;
+    int ramCheckFrame = 0;
+    std::atomic<uint64_t> ramFlushes{0};
+    std::atomic<uint64_t> ramBytesWritten{0};
+
+    bool audioInit = false;
+    AudioResampler audioResampler;
 
     float emulationSpeed = 50.27;
-    float frameCounter = 0;
+
+    // the core runs on its own thread; all other access to the core needs to hold coreMutex
+    std::thread emulationThread;
+    std::atomic<bool> emulationRunning{false};
+    std::mutex coreMutex;
+    std::atomic<uint16_t> inputState{0};
+    // time the current input was first seen and the time until the emulation thread ran with it
+    std::atomic<int64_t> inputChangeTime{0};
+    uint16_t lastMappedInput = 0;
+    uint16_t lastRunInput = 0;
+    LatencyHistogram inputLatency;
+    FrameMailbox frameMailbox;
+    // only touched on the emulation thread
+    bool suppressVideo = false;
+    bool suppressAudio = false;
+
+    // run-ahead shows a frame that is a few frames in the future and rolls back to the saved state afterwards
+    const int MaxRunAheadFrames = 4;
+    // part of the frame time run-ahead is allowed to use before it gets turned off
+    const double RunAheadBudget = 0.8;
+    std::atomic<int> runAheadFrames{0};
+    // only touched on the emulation thread
+    std::vector<uint8_t> runAheadState;
+    double runAheadFrameTime = 0;
+    int lastRunAheadFrames = 0;
+
+    // a state gets captured every frame while the rewind button is mapped; holding it steps back one state per frame
+    RewindBuffer rewindBuffer;
+    int rewindBudget = DefaultRewindBudget;
+    std::atomic<bool> rewindEnabled{false};
+    // the settings get applied to the rewind buffer by the emulation thread; the values it applied last
+    std::atomic<size_t> rewindBudgetBytes{0};
+    bool appliedRewindEnabled = false;
+    size_t appliedRewindBudget = 0;
+    std::atomic<bool> rewindHeld{false};
+
+    // holding the fast-forward button runs several frames for every scheduled frame; only the last one gets shown and heard
+    // a speed of 0 runs as many frames as fit into the budget of the frame time
+    const int FastForwardSpeeds[6] = {2, 3, 4, 6, 8, 0};
+    const double UncappedBudget = 0.75;
+    std::atomic<int> fastForwardSpeed{4};
+    std::atomic<bool> fastForwardHeld{false};
+    // frames run by the core including the ones that were not shown
+    std::atomic<uint64_t> coreFrames{0};
+    // the speed gets measured on the render thread over half a second while fast-forwarding
+    const double SpeedSampleTime = 0.5;
+    double speedSampleTime = 0;
+    uint64_t speedSampleFrames = 0;
+    float measuredSpeed = 0;
+
+    // the render thread sets the number of frames the emulation thread should have finished
+    FramePacer framePacer;
+    std::mutex scheduleMutex;
+    std::condition_variable scheduleCondition;
+    uint64_t targetFrame = 0;
+    std::atomic<uint64_t> emulatedFrames{0};
+    // frames that were run without their image because the emulation fell behind
+    std::atomic<uint64_t> catchUpFrames{0};
+    double lastPacingReport = 0;
 
     uint8_t *screenData;
 
@@ -177,20 +348,22 @@ private:
     int screenborder = 1;
     int TextureHeight = VIDEO_HEIGHT * 2 + 1 * 2;//12;
 
-    int32_t *pixelData = new int32_t[VIDEO_WIDTH * TextureHeight];
-
-    int32_t *stateImageData = new int32_t[VIDEO_WIDTH * VIDEO_HEIGHT];
-
     bool useCubeMap = false;
     bool useThreeDeeMode = true;
 
     Rom *CurrentRom = nullptr;
-    GLuint screenFramebuffer[2];
+    Rom loadedRom;
     int romSelection = 0;
 
     std::shared_ptr<MenuList<Rom>> romList;
+    std::shared_ptr<MenuImage> imageSlot;
     std::shared_ptr<MenuButton> screenModeButton, offsetButton, paletteButton;
     std::shared_ptr<MenuButton> rButton, gButton, bButton;
+    std::shared_ptr<MenuButton> runAheadButton;
+    std::shared_ptr<MenuButton> fastForwardSpeedButton;
+    std::shared_ptr<MenuButton> rewindBudgetButton;
+    std::shared_ptr<MenuButton> traceButton;
+    std::shared_ptr<MenuButton> recordMovieButton, playMovieButton;
 
     void OnClickRLeft(MenuItem *item);
 
@@ -206,6 +379,10 @@ private:
 
     void ChangeColor(MenuButton *item, int colorIndex, float dir);
 
+    void SetLuminanceSwizzle();
+
+    void DrawScreen();
+
     void ChangeOffset(MenuButton *item, float dir);
 
     void ChangePalette(MenuButton *item, float dir);
@@ -228,19 +405,83 @@ private:
 
     void OnClickResetOffset(MenuItem *item);
 
+    void OnClickRunAheadLeft(MenuItem *item);
+
+    void OnClickRunAheadRight(MenuItem *item);
+
+    void OnClickSaveTrace(MenuItem *item);
+
+    void OnClickRecordMovie(MenuItem *item);
+
+    void OnClickPlayMovie(MenuItem *item);
+
+    void UpdateMovieLabels(MenuItem *item, uint *buttonState, uint *lastButtonState);
+
+    void StopMovie();
+
+    std::string MoviePath();
+
+    void ChangeRunAhead(MenuButton *item, int dir);
+
+    void UpdateRunAheadLabel(MenuItem *item, uint *buttonState, uint *lastButtonState);
+
+    void OnClickFastForwardLeft(MenuItem *item);
+
+    void OnClickFastForwardRight(MenuItem *item);
+
+    void ChangeFastForwardSpeed(MenuButton *item, int dir);
+
+    void UpdateFastForwardLabel(MenuItem *item, uint *buttonState, uint *lastButtonState);
+
+    void OnClickRewindBudgetLeft(MenuItem *item);
+
+    void OnClickRewindBudgetRight(MenuItem *item);
+
+    void ChangeRewindBudget(MenuButton *item, int dir);
+
+    void UpdateRewindBudgetLabel(MenuItem *item, uint *buttonState, uint *lastButtonState);
+
     void LoadRam();
 
     void LoadGame(Rom *rom);
 
-    bool StateExists(int slot);
-
-    void SaveStateImage(int slot);
+    Rom CreateRom(const std::string &fullPath, const std::string &romName);
 
-    bool LoadStateImage(int slot);
+    void SetRomList(const RomCatalog::EntryList &list);
 
     void AudioFrame(unsigned short *audio, int32_t sampleCount);
 
+    void StartEmulationThread();
+
+    void StopEmulationThread();
+
+    void EmulationLoop();
+
+    void SetFrameInput(uint16_t input);
+
+    void RunFrame();
+
+    void CatchUpFrame();
+
+    void FastForwardFrames(uint16_t input);
+
+    void RewindFrame();
+
+    void CaptureRewindState();
+
+    void ApplyRewindSettings();
+
     void UpdateNoImageSlotLabel(MenuItem *item, uint *buttonState, uint *lastButtonState);
 
+    void UpdateSlotImage(MenuItem *item, uint *buttonState, uint *lastButtonState);
+
     void UpdateEmptySlotLabel(MenuItem *item, uint *buttonState, uint *lastButtonState);
+
+    void UpdateSaveStatusLabel(MenuItem *item, uint *buttonState, uint *lastButtonState);
+
+    void UpdateSaveResults();
+
+    void CompileButtonMapping();
+
+    void FlushRam(bool force);
 };
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// lock free triple buffer used to hand finished frames from the emulation thread to the render thread
+// the producer always has a buffer to write into and the consumer always gets the newest finished frame
+class FrameMailbox {
+public:
+    static const int BufferCount = 3;
+
+    // the frames get written into the given buffers instead of memory owned by the mailbox if external is set;
+    // external buffers have to be cleared and stay valid as long as the mailbox gets used
+    void Init(size_t frameSize, uint8_t *const *external = nullptr) {
+        for (int i = 0; i < BufferCount; ++i) {
+            if (external != nullptr) {
+                std::vector<uint8_t>().swap(buffers[i]);
+                slots[i] = external[i];
+            } else {
+                buffers[i].assign(frameSize, 0);
+                slots[i] = buffers[i].data();
+            }
+        }
+        writeIndex = 0;
+        readIndex = 1;
+        middle.store(2);
+    }
+
+    // producer side
+    uint8_t *WriteBuffer() { return slots[writeIndex]; }
+
+    int WriteIndex() const { return writeIndex; }
+
+    void Publish(uint64_t frameNumber) {
+        frameNumbers[writeIndex] = frameNumber;
+        writeIndex = middle.exchange(writeIndex | FreshBit, std::memory_order_acq_rel) & IndexMask;
+    }
+
+    // consumer side; true if Latch will hand the current read buffer back to the producer
+    bool Pending() const { return (middle.load(std::memory_order_relaxed) & FreshBit) != 0; }
+
+    // returns false if no new frame was published since the last call
+    bool Latch() {
+        if (!Pending())
+            return false;
+
+        readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & IndexMask;
+        return true;
+    }
+
+    const uint8_t *ReadBuffer() const { return slots[readIndex]; }
+
+    int ReadIndex() const { return readIndex; }
+
+    uint64_t ReadFrameNumber() const { return frameNumbers[readIndex]; }
+
+private:
+    static const int IndexMask = 3;
+    static const int FreshBit = 4;
+
+    std::vector<uint8_t> buffers[BufferCount];
+    uint8_t *slots[BufferCount]{};
+    uint64_t frameNumbers[BufferCount]{};
+
+    int writeIndex = 0;
+    int readIndex = 1;
+    // index of the buffer that is neither read nor written plus a flag telling if it holds an unread frame
+    std::atomic<int> middle{2};
+};
@@ -0,0 +1,124 @@
+#include "FramePacer.h"
+
+#include <cmath>
+
+float FramePacer::SelectRefreshRate(const std::vector<float> &supportedRates, float contentRate) {
+    float bestRate = 0;
+    double bestScore = 0;
+
+    for (float rate : supportedRates) {
+        if (rate <= 0)
+            continue;
+
+        double score = JudderScore(rate, contentRate);
+        // prefer the higher rate if the cadence is about the same
+        if (bestRate == 0 || score < bestScore - 0.0001 || (score < bestScore + 0.0001 && rate > bestRate)) {
+            bestRate = rate;
+            bestScore = score;
+        }
+    }
+
+    return bestRate;
+}
+
+double FramePacer::JudderScore(float displayRate, float contentRate) {
+    // rates that are within 0.5% of each other are treated as matching; the frame that gets lost every few seconds is counted as dropped
+    double ratio = displayRate / (double) contentRate;
+    if (std::fabs(ratio - std::round(ratio)) < 0.005 && std::round(ratio) >= 1)
+        return 0;
+
+    // simulate a few seconds of display frames, each showing the newest finished content frame
+    const int displayFrames = (int) (displayRate * 10);
+    std::vector<int> frameDurations((size_t) (contentRate * 10) + 2, 0);
+
+    for (int i = 0; i < displayFrames; ++i) {
+        size_t shownFrame = (size_t) std::floor(i / ratio + 1e-9);
+        if (shownFrame < frameDurations.size())
+            frameDurations[shownFrame]++;
+    }
+
+    // the first and the last frame are cut off by the simulation window
+    double sum = 0, sumSquared = 0;
+    int count = 0;
+    for (size_t i = 1; i + 2 < frameDurations.size(); ++i) {
+        double duration = frameDurations[i] / (double) displayRate;
+        sum += duration;
+        sumSquared += duration * duration;
+        count++;
+    }
+
+    if (count == 0)
+        return 1;
+
+    double mean = sum / count;
+    return std::sqrt(std::fmax(0.0, sumSquared / count - mean * mean));
+}
+
+void FramePacer::Init(float _contentRate, float _displayRate) {
+    contentRate = _contentRate;
+    displayRate = _displayRate;
+    lastDisplayTime = 0;
+}
+
+void FramePacer::SetDisplayRate(float _displayRate) {
+    if (_displayRate > 0)
+        displayRate = _displayRate;
+}
+
+uint64_t FramePacer::Schedule(double predictedDisplayTime, uint64_t emulatedFrames) {
+    // frames get emulated during the current display frame so they are ready for the next one
+    double targetTime = predictedDisplayTime + 1.0 / displayRate;
+
+    // (re)start the cadence with the next emulated frame
+    if (lastDisplayTime == 0 || predictedDisplayTime - lastDisplayTime > ResyncTime || predictedDisplayTime < lastDisplayTime) {
+        startTime = targetTime;
+        startFrame = (int64_t) emulatedFrames + 1;
+        lastPresentedFrame = emulatedFrames;
+        presentTarget = emulatedFrames;
+        lastTarget = emulatedFrames;
+        pendingTargets.clear();
+    }
+    lastDisplayTime = predictedDisplayTime;
+
+    int64_t target = startFrame + (int64_t) std::floor((targetTime - startTime) * contentRate);
+
+    // drop the time debt instead of running a long burst of frames after a long hitch
+    if (target > (int64_t) emulatedFrames + MaxCatchUpFrames) {
+        int64_t behind = target - ((int64_t) emulatedFrames + MaxCatchUpFrames);
+        skippedFrames += behind;
+        startFrame -= behind;
+        target -= behind;
+    }
+
+    presentTarget = lastTarget;
+    lastTarget = (uint64_t) target;
+    if (lastTarget > emulatedFrames && (pendingTargets.empty() || lastTarget > pendingTargets.back())) {
+        pendingTargets.push_back(lastTarget);
+        // only happens if frames stop getting presented
+        if (pendingTargets.size() > MaxPendingTargets)
+            pendingTargets.pop_front();
+    }
+    scheduled = true;
+
+    return lastTarget;
+}
+
+void FramePacer::Present(bool newFrame, uint64_t frameNumber) {
+    // only count while the game is running
+    if (!scheduled)
+        return;
+    scheduled = false;
+
+    if (newFrame && frameNumber > lastPresentedFrame) {
+        // scheduled frames that got replaced by a newer one before they were shown
+        while (!pendingTargets.empty() && pendingTargets.front() <= frameNumber) {
+            droppedFrames += pendingTargets.front() < frameNumber;
+            pendingTargets.pop_front();
+        }
+        lastPresentedFrame = frameNumber;
+        presentedFrames++;
+    } else if (presentTarget > lastPresentedFrame) {
+        // a new frame should have been ready for this display frame
+        duplicatedFrames++;
+    }
+}
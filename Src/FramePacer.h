@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// decides how many emulated frames should be finished for each display frame
+// and keeps track of scheduled frames that never got shown (dropped) or got shown for too long (duplicated)
+// frames in between the scheduled ones (catch-up, fast-forward) are not meant to be shown and do not count as dropped
+class FramePacer {
+public:
+    // the emulation catches up on this many frames after a hitch by running them without showing them;
+    // only the time debt beyond that gets dropped (skipped) and slows down the game
+    static const int MaxCatchUpFrames = 10;
+
+    // returns the supported refresh rate with the most even cadence for the given content rate
+    static float SelectRefreshRate(const std::vector<float> &supportedRates, float contentRate);
+
+    // standard deviation of the time each content frame stays on screen in seconds; 0 means no judder
+    static double JudderScore(float displayRate, float contentRate);
+
+    void Init(float _contentRate, float _displayRate);
+
+    void SetDisplayRate(float _displayRate);
+
+    // called once per display frame with the predicted display time of the current frame
+    // returns the number of emulated frames that should be finished for the next display frame
+    uint64_t Schedule(double predictedDisplayTime, uint64_t emulatedFrames);
+
+    // called once per display frame after trying to latch a new emulated frame
+    void Present(bool newFrame, uint64_t frameNumber);
+
+    uint64_t PresentedFrames() const { return presentedFrames; }
+
+    uint64_t DroppedFrames() const { return droppedFrames; }
+
+    uint64_t DuplicatedFrames() const { return duplicatedFrames; }
+
+    uint64_t SkippedFrames() const { return skippedFrames; }
+
+private:
+    // a bigger gap between two display frames means the game was paused and the cadence gets restarted
+    const double ResyncTime = 0.25;
+    const size_t MaxPendingTargets = 64;
+
+    double contentRate = 50.27;
+    double displayRate = 60;
+
+    double startTime = 0;
+    int64_t startFrame = 0;
+    double lastDisplayTime = 0;
+
+    uint64_t lastTarget = 0;
+    uint64_t presentTarget = 0;
+    uint64_t lastPresentedFrame = 0;
+    bool scheduled = false;
+    // targets that were scheduled but not presented yet
+    std::deque<uint64_t> pendingTargets;
+
+    uint64_t presentedFrames = 0;
+    uint64_t droppedFrames = 0;
+    uint64_t duplicatedFrames = 0;
+    uint64_t skippedFrames = 0;
+};
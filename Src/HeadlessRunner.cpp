@@ -0,0 +1,433 @@
+//
+// Headless frame loop for measuring the emulation throughput on linux.
+// Loads a rom the same way Emulator::LoadGame does and runs the core as fast as possible
+// with the video and audio callbacks connected to counting sinks.
+// With -s it replays the movies of a suite and compares the video and audio with golden checksums.
+// With -r it records the input of the run into a movie that starts from power on (or from the start state of the -m movie).
+//
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include <BeetleVBLibretroGo/mednafen/vrvb.h>
+
+#include "FrameMailbox.h"
+#include "InputMovie.h"
+#include "MappedFile.h"
+#include "StateFile.h"
+#include "TraceRecorder.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const int VIDEO_WIDTH = 384;
+const int VIDEO_HEIGHT = 224;
+const int screenborder = 1;
+const int TextureHeight = VIDEO_HEIGHT * 2 + screenborder * 2;
+const int ScreenBandRows = 16;
+const int ScreenBands = VIDEO_HEIGHT / ScreenBandRows;
+
+struct FrameStats {
+    uint64_t videoFrames = 0;
+    uint64_t audioSamples = 0;
+    uint64_t dirtyBands = 0;
+    double runSeconds = 0;
+    double frontendSeconds = 0;
+};
+
+FrameStats stats;
+FrameMailbox frameMailbox;
+// previous frame the changed bands get found with
+std::vector<uint8_t> videoFrame(VIDEO_WIDTH * TextureHeight);
+uint32_t romCrc = 0;
+
+// checksums of both eyes of the frame and of the audio since the last checkpoint
+struct Checkpoint {
+    uint32_t frame;
+    uint32_t left;
+    uint32_t right;
+    uint32_t audio;
+};
+
+const int CheckpointFrames = 50;
+bool hashAudio = false;
+uint32_t audioCrc = 0;
+
+double SecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// does the same cpu work as Emulator::VB_VIDEO_CB
+void VideoSink(const void *data, unsigned int width, unsigned int height) {
+    TraceRecorder::Scope trace("VideoCopy");
+    Clock::time_point start = Clock::now();
+    const uint8_t *dataArray = (const uint8_t *) data;
+    for (int eye = 0; eye < 2; ++eye) {
+        for (int band = 0; band < ScreenBands; ++band) {
+            const uint8_t *bandData = &dataArray[(eye * (VIDEO_HEIGHT + 12) + band * ScreenBandRows) * VIDEO_WIDTH];
+            uint8_t *bandCopy = &videoFrame[(eye * (VIDEO_HEIGHT + screenborder * 2) + band * ScreenBandRows) * VIDEO_WIDTH];
+            if (memcmp(bandData, bandCopy, ScreenBandRows * VIDEO_WIDTH) != 0) {
+                memcpy(bandCopy, bandData, ScreenBandRows * VIDEO_WIDTH);
+                stats.dirtyBands++;
+            }
+        }
+    }
+    uint8_t *frame = frameMailbox.WriteBuffer();
+    memcpy(frame, dataArray, VIDEO_WIDTH * VIDEO_HEIGHT);
+    memcpy(&frame[(VIDEO_HEIGHT + screenborder * 2) * VIDEO_WIDTH], &dataArray[(VIDEO_HEIGHT + 12) * VIDEO_WIDTH], VIDEO_WIDTH * VIDEO_HEIGHT);
+    stats.videoFrames++;
+    frameMailbox.Publish(stats.videoFrames);
+    stats.frontendSeconds += SecondsSince(start);
+}
+
+void AudioSink(int16_t *soundBuf, int32_t soundBufSize) {
+    Clock::time_point start = Clock::now();
+    stats.audioSamples += (uint64_t) soundBufSize;
+    // the buffer holds soundBufSize stereo samples
+    if (hashAudio)
+        audioCrc = StateFile::Crc32(audioCrc, (const uint8_t *) soundBuf, soundBufSize * 2 * sizeof(int16_t));
+    stats.frontendSeconds += SecondsSince(start);
+}
+
+bool LoadGame(const std::string &path) {
+    MappedFile romFile;
+    if (!romFile.Open(path))
+        return false;
+
+    VRVB::LoadRom(romFile.Data(), romFile.Size());
+    romCrc = StateFile::Crc32(0, romFile.Data(), romFile.Size());
+    return true;
+}
+
+// the movie starts from its state or from the freshly loaded rom
+bool LoadMovie(const std::string &path, InputMovie &movie) {
+    MappedFile movieFile;
+    if (!movieFile.Open(path) || !movie.Load(movieFile.Data(), movieFile.Size(), romCrc, VRVB::retro_serialize_size()))
+        return false;
+
+    return movie.PowerOn() || VRVB::retro_unserialize(movie.StartState().data(), movie.StartState().size());
+}
+
+// input script: one "<frames> <buttons>" line per input with the buttons as hex mask of VRVB::input_buf; # starts a comment
+bool LoadInputScript(const std::string &path, InputMovie &script) {
+    FILE *file = fopen(path.c_str(), "r");
+    if (file == nullptr)
+        return false;
+
+    script.StartRecording(romCrc, nullptr, 0);
+    char line[256];
+    unsigned int frames, buttons;
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        if (line[0] == '#' || sscanf(line, "%u %x", &frames, &buttons) != 2)
+            continue;
+        for (unsigned int i = 0; i < frames; ++i)
+            script.RecordFrame((uint16_t) buttons);
+    }
+    fclose(file);
+    return script.FrameCount() > 0;
+}
+
+bool WriteMovie(const std::string &path, const InputMovie &movie) {
+    std::vector<uint8_t> data;
+    movie.Serialize(data);
+
+    int file = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file < 0)
+        return false;
+    bool written = InputMovie::Write(file, data);
+    return close(file) == 0 && written;
+}
+
+// checksum of the state after the run; replaying the same movie needs to end with the same checksum
+uint32_t StateCrc() {
+    std::vector<uint8_t> state(VRVB::retro_serialize_size());
+    if (state.empty() || !VRVB::retro_serialize(state.data(), state.size()))
+        return 0;
+    return StateFile::Crc32(0, state.data(), state.size());
+}
+
+// the eyes are hashed as the frontend stores them for the screen texture
+Checkpoint TakeCheckpoint(uint32_t frame) {
+    const uint8_t *screen = frameMailbox.ReadBuffer();
+    Checkpoint checkpoint = {frame,
+                             StateFile::Crc32(0, screen, VIDEO_WIDTH * VIDEO_HEIGHT),
+                             StateFile::Crc32(0, screen + (VIDEO_HEIGHT + screenborder * 2) * VIDEO_WIDTH, VIDEO_WIDTH * VIDEO_HEIGHT),
+                             audioCrc};
+    audioCrc = 0;
+    return checkpoint;
+}
+
+// golden file: a comment with the frames/sec of the run that wrote it and one checkpoint per line
+bool ReadGolden(const std::string &path, std::vector<Checkpoint> &checkpoints, double &fps) {
+    FILE *file = fopen(path.c_str(), "r");
+    if (file == nullptr)
+        return false;
+
+    char line[256];
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        Checkpoint checkpoint;
+        if (sscanf(line, "# fps %lf", &fps) == 1)
+            continue;
+        if (sscanf(line, "%u %x %x %x", &checkpoint.frame, &checkpoint.left, &checkpoint.right, &checkpoint.audio) == 4)
+            checkpoints.push_back(checkpoint);
+    }
+    fclose(file);
+    return true;
+}
+
+bool WriteGolden(const std::string &path, const std::vector<Checkpoint> &checkpoints, double fps) {
+    FILE *file = fopen(path.c_str(), "w");
+    if (file == nullptr)
+        return false;
+
+    fprintf(file, "# fps %.2f\n", fps);
+    for (const Checkpoint &checkpoint : checkpoints)
+        fprintf(file, "%u %08x %08x %08x\n", checkpoint.frame, checkpoint.left, checkpoint.right, checkpoint.audio);
+    return fclose(file) == 0;
+}
+
+// replays the movie from the start and takes a checkpoint every CheckpointFrames frames and after the last one
+bool RunMovie(const std::string &romPath, const std::string &moviePath, std::vector<Checkpoint> &checkpoints, double &fps) {
+    stats = FrameStats();
+    frameMailbox.Init(VIDEO_WIDTH * TextureHeight);
+    videoFrame.assign(videoFrame.size(), 0);
+    audioCrc = 0;
+
+    InputMovie movie;
+    if (!LoadGame(romPath))
+        return false;
+    if (!LoadMovie(moviePath, movie)) {
+        VRVB::unload_game();
+        return false;
+    }
+
+    Clock::time_point start = Clock::now();
+    uint16_t input;
+    uint32_t frame = 0;
+    while (movie.NextFrame(input)) {
+        VRVB::input_buf[0] = input;
+        VRVB::Run();
+        frameMailbox.Latch();
+
+        frame++;
+        if (frame % CheckpointFrames == 0 || frame == movie.FrameCount())
+            checkpoints.push_back(TakeCheckpoint(frame));
+    }
+    fps = frame / SecondsSince(start);
+
+    VRVB::unload_game();
+    return true;
+}
+
+// suite file: one "<rom> <movie> <golden>" per line, relative to the folder of the suite file
+// returns the number of failed entries; with update the golden files get written instead of compared
+int RunSuite(const std::string &suitePath, bool update) {
+    FILE *suite = fopen(suitePath.c_str(), "r");
+    if (suite == nullptr) {
+        printf("could not open suite: %s\n", suitePath.c_str());
+        return 1;
+    }
+
+    size_t folderEnd = suitePath.find_last_of('/');
+    std::string folder = folderEnd == std::string::npos ? "" : suitePath.substr(0, folderEnd + 1);
+
+    hashAudio = true;
+    int entries = 0, failed = 0;
+    char line[1024], rom[256], movie[256], golden[256];
+    while (fgets(line, sizeof(line), suite) != nullptr) {
+        if (line[0] == '#' || sscanf(line, "%255s %255s %255s", rom, movie, golden) != 3)
+            continue;
+        entries++;
+
+        std::vector<Checkpoint> checkpoints;
+        double fps = 0;
+        if (!RunMovie(folder + rom, folder + movie, checkpoints, fps)) {
+            printf("FAIL    %s: could not load %s or %s\n", movie, rom, movie);
+            failed++;
+            continue;
+        }
+
+        if (update) {
+            bool written = WriteGolden(folder + golden, checkpoints, fps);
+            printf("%s %s: %zu checkpoints, %.1f fps\n", written ? "UPDATED" : "FAIL   ", movie, checkpoints.size(), fps);
+            failed += !written;
+            continue;
+        }
+
+        std::vector<Checkpoint> expected;
+        double baselineFps = 0;
+        if (!ReadGolden(folder + golden, expected, baselineFps)) {
+            printf("FAIL    %s: no golden file %s, run with -u to write it\n", movie, golden);
+            failed++;
+            continue;
+        }
+
+        // the first checkpoint that differs tells which part of the output changed
+        const char *mismatch = nullptr;
+        uint32_t mismatchFrame = 0;
+        for (size_t i = 0; i < checkpoints.size() || i < expected.size(); ++i) {
+            if (i >= checkpoints.size() || i >= expected.size() || checkpoints[i].frame != expected[i].frame)
+                mismatch = "frame count";
+            else if (checkpoints[i].left != expected[i].left)
+                mismatch = "left eye";
+            else if (checkpoints[i].right != expected[i].right)
+                mismatch = "right eye";
+            else if (checkpoints[i].audio != expected[i].audio)
+                mismatch = "audio";
+
+            if (mismatch != nullptr) {
+                mismatchFrame = i < checkpoints.size() ? checkpoints[i].frame : expected[i].frame;
+                break;
+            }
+        }
+
+        if (mismatch != nullptr) {
+            printf("FAIL    %s: %s differs at frame %u\n", movie, mismatch, mismatchFrame);
+            failed++;
+        } else {
+            printf("PASS    %s: %zu checkpoints, %.1f fps (golden %.1f fps, %+.1f%%)\n", movie, checkpoints.size(), fps, baselineFps,
+                   baselineFps > 0 ? (fps / baselineFps - 1) * 100 : 0.0);
+        }
+    }
+    fclose(suite);
+
+    printf("%d of %d passed\n", entries - failed, entries);
+    return failed;
+}
+
+}
+
+int main(int argc, char **argv) {
+    // -m <movie> replays the input of a movie, -i <script> runs the input of an input script,
+    // -r <movie> records the input of the run, -s <suite> runs the golden checks (-u writes the golden files)
+    // the other arguments are positional
+    const char *moviePath = nullptr;
+    const char *scriptPath = nullptr;
+    const char *recordPath = nullptr;
+    const char *suitePath = nullptr;
+    bool updateGolden = false;
+    std::vector<const char *> args;
+    for (int i = 0; i < argc; ++i) {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+            moviePath = argv[++i];
+        else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+            scriptPath = argv[++i];
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            suitePath = argv[++i];
+        else if (strcmp(argv[i], "-u") == 0)
+            updateGolden = true;
+        else
+            args.push_back(argv[i]);
+    }
+    argc = (int) args.size();
+    argv = (char **) args.data();
+
+    if ((argc < 2 && suitePath == nullptr) || (moviePath != nullptr && scriptPath != nullptr)) {
+        printf("usage: %s [-m movie | -i script] [-r movie] <rom> [frames] [trace.json]\n", argv[0]);
+        printf("       %s -s <suite> [-u]\n", argv[0]);
+        return 1;
+    }
+
+    frameMailbox.Init(VIDEO_WIDTH * TextureHeight);
+    TraceRecorder::SetThreadName("emulation");
+
+    VRVB::Init();
+    VRVB::audio_cb = AudioSink;
+    VRVB::video_cb = VideoSink;
+
+    if (suitePath != nullptr)
+        return RunSuite(suitePath, updateGolden) == 0 ? 0 : 1;
+
+    int frameCount = argc > 2 ? atoi(argv[2]) : 0;
+
+    if (!LoadGame(argv[1])) {
+        printf("could not load rom file: %s\n", argv[1]);
+        return 1;
+    }
+
+    // without a frame count the whole movie gets played
+    InputMovie movie;
+    if (moviePath != nullptr) {
+        if (!LoadMovie(moviePath, movie)) {
+            printf("could not load movie: %s\n", moviePath);
+            VRVB::unload_game();
+            return 1;
+        }
+        if (frameCount <= 0)
+            frameCount = (int) movie.FrameCount();
+    } else if (scriptPath != nullptr) {
+        if (!LoadInputScript(scriptPath, movie)) {
+            printf("could not load input script: %s\n", scriptPath);
+            VRVB::unload_game();
+            return 1;
+        }
+        if (frameCount <= 0)
+            frameCount = (int) movie.FrameCount();
+    }
+    if (frameCount <= 0)
+        frameCount = 3000;
+
+    // the recording starts where the run starts; without a movie state that is power on
+    InputMovie recording;
+    if (moviePath != nullptr && !movie.PowerOn())
+        recording.StartRecording(romCrc, movie.StartState().data(), movie.StartState().size());
+    else
+        recording.StartRecording(romCrc, nullptr, 0);
+
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < frameCount; ++i) {
+        TraceRecorder::Scope trace("RunFrame");
+        uint16_t input = 0;
+        if (moviePath != nullptr || scriptPath != nullptr)
+            movie.NextFrame(input);
+        VRVB::input_buf[0] = input;
+        recording.RecordFrame(input);
+
+        Clock::time_point frameStart = Clock::now();
+        VRVB::Run();
+        stats.runSeconds += SecondsSince(frameStart);
+        frameMailbox.Latch();
+    }
+    double totalSeconds = SecondsSince(start);
+
+    double coreSeconds = stats.runSeconds - stats.frontendSeconds;
+    printf("rom:         %s\n", argv[1]);
+    printf("frames:      %d (%llu video, %llu audio samples)\n", frameCount,
+           (unsigned long long) stats.videoFrames, (unsigned long long) stats.audioSamples);
+    printf("fps:         %.2f (%.2fx realtime)\n", frameCount / totalSeconds, frameCount / totalSeconds / 50.27);
+    printf("core:        %.3f ms/frame\n", coreSeconds * 1000.0 / frameCount);
+    printf("frontend:    %.3f ms/frame\n", stats.frontendSeconds * 1000.0 / frameCount);
+    printf("screen:      %.1f%% of the bands changed\n", stats.videoFrames > 0 ? stats.dirtyBands * 100.0 / (stats.videoFrames * 2 * ScreenBands) : 0.0);
+    if (moviePath != nullptr)
+        printf("movie:       %u of %u frames, state crc %08x\n", movie.PlayedFrames(), movie.FrameCount(), StateCrc());
+    if (recordPath != nullptr) {
+        if (WriteMovie(recordPath, recording))
+            printf("recorded:    %s, %u frames from %s\n", recordPath, recording.FrameCount(), recording.PowerOn() ? "power on" : "the movie state");
+        else
+            printf("could not write movie: %s\n", recordPath);
+    }
+
+    // the trace only holds the last frames of the run
+    if (argc > 3) {
+        std::string json;
+        TraceRecorder::Dump(json);
+        FILE *traceFile = fopen(argv[3], "wb");
+        if (traceFile == nullptr || fwrite(json.data(), 1, json.size(), traceFile) != json.size())
+            printf("could not write trace file: %s\n", argv[3]);
+        else
+            printf("trace:       %s\n", argv[3]);
+        if (traceFile != nullptr)
+            fclose(traceFile);
+    }
+
+    VRVB::unload_game();
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include "InputMovie.h"
+
+#include <cstring>
+
+#include <OVR_LogUtils.h>
+
+#include "SaveWriter.h"
+#include "StateFile.h"
+
+void InputMovie::StartRecording(uint32_t crc, const uint8_t *state, size_t stateSize) {
+    romCrc = crc;
+    frameCount = 0;
+    runs.clear();
+    playRun = 0;
+    playRunFrame = 0;
+    playedFrames = 0;
+    startState.assign(state, state + (state != nullptr ? stateSize : 0));
+}
+
+void InputMovie::RecordFrame(uint16_t input) {
+    frameCount++;
+    if (!runs.empty() && runs.back().input == input && runs.back().frames < UINT16_MAX)
+        runs.back().frames++;
+    else
+        runs.push_back({input, 1});
+}
+
+void InputMovie::Serialize(std::vector<uint8_t> &data) const {
+    Header header = {Magic, Version, romCrc, frameCount, (uint32_t) runs.size(), (uint32_t) startState.size()};
+    size_t runsSize = runs.size() * sizeof(Run);
+    uint32_t crc = StateFile::Crc32(0, (const uint8_t *) runs.data(), runsSize);
+
+    data.resize(sizeof(header) + runsSize + sizeof(crc) + startState.size());
+    uint8_t *out = data.data();
+    memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+    if (!runs.empty())
+        memcpy(out, runs.data(), runsSize);
+    out += runsSize;
+    memcpy(out, &crc, sizeof(crc));
+    out += sizeof(crc);
+    if (!startState.empty())
+        memcpy(out, startState.data(), startState.size());
+}
+
+bool InputMovie::Write(int file, const std::vector<uint8_t> &data) {
+    Header header;
+    memcpy(&header, data.data(), sizeof(header));
+    size_t stateOffset = data.size() - header.stateSize;
+
+    if (!SaveWriter::WriteAll(file, data.data(), stateOffset))
+        return false;
+
+    return header.stateSize == 0 || StateFile::Write(file, data.data() + stateOffset, header.stateSize, header.romCrc);
+}
+
+bool InputMovie::Load(const uint8_t *data, size_t length, uint32_t crc, size_t stateSize) {
+    runs.clear();
+    startState.clear();
+    playRun = 0;
+    playRunFrame = 0;
+    playedFrames = 0;
+
+    Header header;
+    if (length < sizeof(header))
+        return false;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != Magic || header.version != Version) {
+        OVR_LOG("movie is not of version %u", Version);
+        return false;
+    }
+    if (header.romCrc != crc || (header.stateSize != 0 && header.stateSize != stateSize)) {
+        OVR_LOG("movie is from a different game (crc %08x, state size %u)", header.romCrc, header.stateSize);
+        return false;
+    }
+
+    size_t runsSize = (size_t) header.runCount * sizeof(Run);
+    if (runsSize + sizeof(uint32_t) > length - sizeof(header))
+        return false;
+
+    const uint8_t *in = data + sizeof(header);
+    runs.resize(header.runCount);
+    if (!runs.empty())
+        memcpy(runs.data(), in, runsSize);
+    in += runsSize;
+
+    uint32_t fileCrc;
+    memcpy(&fileCrc, in, sizeof(fileCrc));
+    in += sizeof(fileCrc);
+
+    uint32_t frames = 0;
+    bool emptyRun = false;
+    for (const Run &run : runs) {
+        frames += run.frames;
+        emptyRun = emptyRun || run.frames == 0;
+    }
+    if (emptyRun || fileCrc != StateFile::Crc32(0, (const uint8_t *) runs.data(), runsSize) || frames != header.frameCount) {
+        OVR_LOG("movie checksum does not match");
+        runs.clear();
+        return false;
+    }
+
+    if (header.stateSize != 0 && !StateFile::Read(in, length - (in - data), crc, stateSize, startState)) {
+        runs.clear();
+        return false;
+    }
+
+    romCrc = crc;
+    frameCount = header.frameCount;
+    return true;
+}
+
+bool InputMovie::NextFrame(uint16_t &input) {
+    if (playRun >= runs.size())
+        return false;
+
+    input = runs[playRun].input;
+    playedFrames++;
+    if (++playRunFrame >= runs[playRun].frames) {
+        playRun++;
+        playRunFrame = 0;
+    }
+    return true;
+}
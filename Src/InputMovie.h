@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// the input of every emulated frame, stored as runs of frames with the same input
+// a movie starts either from a save state or from power on (the rom loaded without sram)
+// the device records from the current state; power on movies get recorded by the headless runner with -r
+// file: header, runs, checksum of the runs and the start state as a state file
+class InputMovie {
+public:
+    static const uint32_t Magic = 0x564d4256; // "VBMV"
+    static const uint32_t Version = 1;
+
+    // without a state the movie starts from power on
+    void StartRecording(uint32_t romCrc, const uint8_t *state, size_t stateSize);
+
+    void RecordFrame(uint16_t input);
+
+    // the state is stored uncompressed in the data; Write compresses it
+    void Serialize(std::vector<uint8_t> &data) const;
+
+    // writes serialized movie data into the file; used as write function of the save writer
+    static bool Write(int file, const std::vector<uint8_t> &data);
+
+    // fails if the movie is not for the rom, the state has a different size or the file is corrupt
+    bool Load(const uint8_t *data, size_t length, uint32_t romCrc, size_t stateSize);
+
+    // returns false after the last frame
+    bool NextFrame(uint16_t &input);
+
+    bool PowerOn() const { return startState.empty(); }
+
+    const std::vector<uint8_t> &StartState() const { return startState; }
+
+    uint32_t FrameCount() const { return frameCount; }
+
+    uint32_t PlayedFrames() const { return playedFrames; }
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t romCrc;
+        uint32_t frameCount;
+        uint32_t runCount;
+        uint32_t stateSize;
+    };
+
+    struct Run {
+        uint16_t input;
+        uint16_t frames;
+    };
+
+    std::vector<Run> runs;
+    std::vector<uint8_t> startState;
+    uint32_t romCrc = 0;
+    uint32_t frameCount = 0;
+
+    size_t playRun = 0;
+    uint32_t playRunFrame = 0;
+    uint32_t playedFrames = 0;
+};
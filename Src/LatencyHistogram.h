@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// histogram of latencies in 0.5ms buckets up to 64ms; the last bucket also counts everything above
+// samples are added by one thread and can be read from any other
+class LatencyHistogram {
+public:
+    static const int BucketCount = 128;
+
+    void Add(double seconds) {
+        int bucket = (int) (seconds / BucketSeconds);
+        if (bucket < 0)
+            bucket = 0;
+        else if (bucket >= BucketCount)
+            bucket = BucketCount - 1;
+
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        if (seconds > maxSeconds.load(std::memory_order_relaxed))
+            maxSeconds.store(seconds, std::memory_order_relaxed);
+    }
+
+    uint64_t Count() const { return count.load(std::memory_order_relaxed); }
+
+    double Max() const { return maxSeconds.load(std::memory_order_relaxed); }
+
+    // upper end of the bucket the given fraction of the samples falls into
+    double Percentile(double fraction) const {
+        uint64_t total = Count();
+        uint64_t target = (uint64_t) (total * fraction);
+        uint64_t sum = 0;
+        for (int i = 0; i < BucketCount; ++i) {
+            sum += buckets[i].load(std::memory_order_relaxed);
+            if (sum > target)
+                return (i + 1) * BucketSeconds;
+        }
+        return BucketCount * BucketSeconds;
+    }
+
+    // non empty buckets as "upper end in ms:count"
+    std::string ToString() const {
+        std::string text;
+        char entry[32];
+        for (int i = 0; i < BucketCount; ++i) {
+            uint64_t bucketCount = buckets[i].load(std::memory_order_relaxed);
+            if (bucketCount == 0)
+                continue;
+
+            snprintf(entry, sizeof(entry), "%s%.1f:%llu", text.empty() ? "" : " ", (i + 1) * BucketSeconds * 1000, (unsigned long long) bucketCount);
+            text += entry;
+        }
+        return text;
+    }
+
+private:
+    static constexpr double BucketSeconds = 0.0005;
+
+    std::atomic<uint64_t> buckets[BucketCount] = {};
+    std::atomic<uint64_t> count{0};
+    std::atomic<double> maxSeconds{0};
+};
@@ -0,0 +1,66 @@
+#include "MappedFile.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <OVR_LogUtils.h>
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+bool MappedFile::Open(const std::string &path, Access access) {
+    Close();
+
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0)
+        return false;
+
+    struct stat fileStat;
+    bool success = fstat(file, &fileStat) == 0 && Map(file, 0, (size_t) fileStat.st_size, access);
+    close(file);
+
+    if (!success)
+        OVR_LOG("could not map %s", path.c_str());
+    return success;
+}
+
+bool MappedFile::Map(int file, uint64_t offset, size_t length, Access access) {
+    Close();
+    if (length == 0)
+        return false;
+
+    // mappings need to start at a page boundary
+    uint64_t pageSize = (uint64_t) sysconf(_SC_PAGESIZE);
+    uint64_t pageOffset = offset % pageSize;
+
+    mappingSize = length + pageOffset;
+    mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, file, (off_t) (offset - pageOffset));
+    if (mapping == MAP_FAILED) {
+        OVR_LOG("mmap failed: %s", strerror(errno));
+        mapping = nullptr;
+        mappingSize = 0;
+        return false;
+    }
+
+    // sequential reads get read ahead more aggressively; random access gets the whole range loaded
+    madvise(mapping, mappingSize, access == Sequential ? MADV_SEQUENTIAL : MADV_WILLNEED);
+
+    data = (const uint8_t *) mapping + pageOffset;
+    size = length;
+    return true;
+}
+
+void MappedFile::Close() {
+    if (mapping != nullptr)
+        munmap(mapping, mappingSize);
+
+    mapping = nullptr;
+    mappingSize = 0;
+    data = nullptr;
+    size = 0;
+}
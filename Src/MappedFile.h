@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// read only memory mapping of a file or a part of it
+class MappedFile {
+public:
+    enum Access {
+        Sequential,
+        Random
+    };
+
+    MappedFile() = default;
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile();
+
+    // maps the whole file
+    bool Open(const std::string &path, Access access = Sequential);
+
+    // maps a range of an open file; the file can be closed afterwards
+    bool Map(int file, uint64_t offset, size_t length, Access access = Sequential);
+
+    void Close();
+
+    const uint8_t *Data() const { return data; }
+
+    size_t Size() const { return size; }
+
+private:
+    void *mapping = nullptr;
+    size_t mappingSize = 0;
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+};
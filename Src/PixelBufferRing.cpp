@@ -0,0 +1,85 @@
+#include "PixelBufferRing.h"
+
+#include <cstring>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2ext.h>
+#include <OVR_LogUtils.h>
+
+namespace {
+
+// one frame is the longest the render thread should ever wait for a buffer
+const GLuint64 FenceTimeout = 20 * 1000 * 1000;
+
+const GLbitfield PersistentFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT_EXT | GL_MAP_COHERENT_BIT_EXT;
+
+}
+
+bool PixelBufferRing::Init(size_t bufferSize, int bufferCount) {
+    PFNGLBUFFERSTORAGEEXTPROC bufferStorage = nullptr;
+    const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+    if (extensions != nullptr && strstr(extensions, "GL_EXT_buffer_storage") != nullptr)
+        bufferStorage = (PFNGLBUFFERSTORAGEEXTPROC) eglGetProcAddress("glBufferStorageEXT");
+
+    if (bufferStorage == nullptr) {
+        OVR_LOG("pixel buffer: GL_EXT_buffer_storage not supported");
+        return false;
+    }
+
+    buffers.resize(bufferCount);
+    bool success = true;
+    for (Buffer &buffer : buffers) {
+        glGenBuffers(1, &buffer.id);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+        bufferStorage(GL_PIXEL_UNPACK_BUFFER, bufferSize, nullptr, PersistentFlags);
+        buffer.mapped = (uint8_t *) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bufferSize, PersistentFlags);
+        if (buffer.mapped != nullptr)
+            memset(buffer.mapped, 0, bufferSize);
+        success = success && buffer.mapped != nullptr;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (!success)
+        Shutdown();
+
+    OVR_LOG("pixel buffer: %i buffers %s", bufferCount, success ? "mapped persistently" : "could not be mapped");
+    return success;
+}
+
+void PixelBufferRing::Shutdown() {
+    for (Buffer &buffer : buffers) {
+        if (buffer.fence != nullptr)
+            glDeleteSync(buffer.fence);
+
+        if (buffer.mapped != nullptr) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        glDeleteBuffers(1, &buffer.id);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    buffers.clear();
+}
+
+void PixelBufferRing::Bind(int index) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[index].id);
+}
+
+void PixelBufferRing::Submit(int index) {
+    Buffer &buffer = buffers[index];
+    if (buffer.fence != nullptr)
+        glDeleteSync(buffer.fence);
+    buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void PixelBufferRing::Wait(int index) {
+    Buffer &buffer = buffers[index];
+    if (buffer.fence == nullptr)
+        return;
+
+    // the uploads were issued a frame ago so the wait usually returns right away
+    glClientWaitSync(buffer.fence, GL_SYNC_FLUSH_COMMANDS_BIT, FenceTimeout);
+    glDeleteSync(buffer.fence);
+    buffer.fence = nullptr;
+}
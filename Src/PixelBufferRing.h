@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <GLES3/gl3.h>
+
+// pixel unpack buffers that are mapped once, persistently and coherently, so any thread can write into them
+// the mapping is write only and usually uncached; the cpu must not read from the buffers
+// this needs GL_EXT_buffer_storage; without it Init fails and the textures get uploaded from client memory
+// a fence per buffer makes sure the gpu finished reading a buffer before it gets written again
+class PixelBufferRing {
+public:
+    // returns false if the buffers could not be created and mapped; all buffers start cleared
+    bool Init(size_t bufferSize, int bufferCount);
+
+    void Shutdown();
+
+    uint8_t *Data(int index) const { return buffers[index].mapped; }
+
+    // binds the buffer to GL_PIXEL_UNPACK_BUFFER; the texture uploads then take the offset into the buffer instead of a pointer
+    void Bind(int index);
+
+    // fences the uploads from the buffer and unbinds it
+    void Submit(int index);
+
+    // waits until the gpu finished the uploads from the buffer so it can be written again
+    void Wait(int index);
+
+    bool Persistent() const { return !buffers.empty(); }
+
+private:
+    struct Buffer {
+        GLuint id = 0;
+        uint8_t *mapped = nullptr;
+        GLsync fence = nullptr;
+    };
+
+    std::vector<Buffer> buffers;
+};
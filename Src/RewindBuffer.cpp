@@ -0,0 +1,250 @@
+#include "RewindBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+void WriteVarint(uint8_t *&out, size_t value) {
+    while (value >= 0x80) {
+        *out++ = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t) value;
+}
+
+size_t ReadVarint(const uint8_t *&in) {
+    size_t value = 0;
+    int shift = 0;
+    while (*in & 0x80) {
+        value |= (size_t) (*in++ & 0x7F) << shift;
+        shift += 7;
+    }
+    value |= (size_t) *in++ << shift;
+    return value;
+}
+
+// number of bytes that are the same in both buffers starting at the beginning
+size_t EqualLength(const uint8_t *a, const uint8_t *b, size_t length) {
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t wordA, wordB;
+        memcpy(&wordA, a + i, 8);
+        memcpy(&wordB, b + i, 8);
+        if (wordA != wordB)
+            break;
+    }
+    while (i < length && a[i] == b[i])
+        i++;
+    return i;
+}
+
+}
+
+void RewindBuffer::Init(size_t budgetBytes) {
+    budget = budgetBytes;
+    entries.clear();
+    head = 0;
+
+    running = true;
+    workerThread = std::thread(&RewindBuffer::WorkerLoop, this);
+}
+
+void RewindBuffer::Shutdown() {
+    if (!workerThread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    condition.notify_all();
+    workerThread.join();
+}
+
+void RewindBuffer::SetBudget(size_t budgetBytes) {
+    std::unique_lock<std::mutex> lock(mutex);
+    WaitIdle(lock);
+    if (budget == budgetBytes)
+        return;
+
+    // the ring gets allocated with the new size by the next capture; the newest state does not live in the ring and is kept
+    budget = budgetBytes;
+    std::vector<uint8_t>().swap(ring);
+    entries.clear();
+    head = 0;
+}
+
+void RewindBuffer::SetEnabled(bool _enabled) {
+    std::unique_lock<std::mutex> lock(mutex);
+    WaitIdle(lock);
+    enabled = _enabled;
+    if (!enabled)
+        FreeMemory();
+}
+
+// needs to hold the mutex
+void RewindBuffer::FreeMemory() {
+    std::vector<uint8_t>().swap(ring);
+    std::vector<uint8_t>().swap(latest);
+    std::vector<uint8_t>().swap(capture);
+    std::vector<uint8_t>().swap(encodeBuffer);
+    entries.clear();
+    head = 0;
+}
+
+void RewindBuffer::Clear() {
+    std::unique_lock<std::mutex> lock(mutex);
+    WaitIdle(lock);
+
+    entries.clear();
+    head = 0;
+    latest.clear();
+}
+
+uint8_t *RewindBuffer::BeginCapture(size_t stateSize) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pending || !enabled || budget == 0)
+        return nullptr;
+
+    if (ring.empty())
+        ring.assign(budget, 0);
+
+    capture.resize(stateSize);
+    return capture.data();
+}
+
+void RewindBuffer::EndCapture() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending = true;
+    }
+    condition.notify_all();
+}
+
+const uint8_t *RewindBuffer::StepBack(size_t &stateSize) {
+    std::unique_lock<std::mutex> lock(mutex);
+    WaitIdle(lock);
+
+    if (entries.empty())
+        return nullptr;
+
+    // the delta is a list of (unchanged length, changed length, changed bytes xor the newer state)
+    Entry entry = entries.back();
+    entries.pop_back();
+    head = entry.offset;
+
+    const uint8_t *in = &ring[entry.offset];
+    const uint8_t *end = in + entry.size;
+    size_t position = 0;
+    while (in < end) {
+        position += ReadVarint(in);
+        size_t length = ReadVarint(in);
+        for (size_t i = 0; i < length; ++i)
+            latest[position + i] ^= in[i];
+        in += length;
+        position += length;
+    }
+
+    stateSize = latest.size();
+    return latest.data();
+}
+
+size_t RewindBuffer::UsedBytes() {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t used = 0;
+    for (const Entry &entry : entries)
+        used += entry.size;
+    return used + latest.size();
+}
+
+size_t RewindBuffer::StateCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return latest.empty() ? 0 : entries.size() + 1;
+}
+
+void RewindBuffer::WaitIdle(std::unique_lock<std::mutex> &lock) {
+    condition.wait(lock, [this] { return !pending; });
+}
+
+void RewindBuffer::WorkerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        condition.wait(lock, [this] { return pending || !running; });
+        if (!running)
+            break;
+
+        // the emulation thread does not touch the buffers while a capture is pending;
+        // the entries and the newest state are only changed while holding the lock because the stats read them
+        lock.unlock();
+        // the first state or a state with a different size starts a new history
+        bool newHistory = latest.size() != capture.size();
+        size_t encodedSize = newHistory ? 0 : Encode();
+        lock.lock();
+
+        if (newHistory) {
+            entries.clear();
+            head = 0;
+        } else {
+            Store(encodeBuffer.data(), encodedSize);
+        }
+        latest.swap(capture);
+
+        pending = false;
+        condition.notify_all();
+    }
+}
+
+// encodes the delta into encodeBuffer and returns its size
+size_t RewindBuffer::Encode() {
+    size_t size = latest.size();
+    encodeBuffer.resize(size + size / 64 + 32);
+    uint8_t *out = encodeBuffer.data();
+
+    // delta to get from the new state back to the current newest one
+    size_t position = 0;
+    while (position < size) {
+        size_t equal = EqualLength(&capture[position], &latest[position], size - position);
+        size_t start = position + equal;
+        if (start == size)
+            break;
+
+        // changed bytes end at the next run of 8 equal bytes
+        size_t changedEnd = start;
+        while (changedEnd < size && EqualLength(&capture[changedEnd], &latest[changedEnd], std::min<size_t>(8, size - changedEnd)) < std::min<size_t>(8, size - changedEnd))
+            changedEnd++;
+
+        WriteVarint(out, equal);
+        WriteVarint(out, changedEnd - start);
+        for (size_t i = start; i < changedEnd; ++i)
+            *out++ = capture[i] ^ latest[i];
+        position = changedEnd;
+    }
+
+    return out - encodeBuffer.data();
+}
+
+// needs to hold the mutex
+void RewindBuffer::Store(const uint8_t *data, size_t size) {
+    if (size > ring.size()) {
+        entries.clear();
+        head = 0;
+        return;
+    }
+
+    if (head + size > ring.size())
+        head = 0;
+
+    // drop the oldest entries until the new one does not overlap with any entry anymore
+    // older entries can not be kept without the newer ones so everything up to the newest overlapping entry goes
+    size_t drop = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].offset < head + size && head < entries[i].offset + entries[i].size)
+            drop = i + 1;
+    }
+    entries.erase(entries.begin(), entries.begin() + drop);
+
+    memcpy(&ring[head], data, size);
+    entries.push_back({head, size});
+    head += size;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed memory history of save states for rewinding
+// every state is stored as the run length encoded xor delta to the state captured after it;
+// only the newest state is kept uncompressed, going back one step applies the newest delta to it
+// the compression runs on a worker thread; the memory only gets allocated with the first capture while enabled
+class RewindBuffer {
+public:
+    void Init(size_t budgetBytes);
+
+    void Shutdown();
+
+    // changes the memory used for the history; drops the history if the size changes
+    // waits for a running compression; call it from the thread that captures
+    void SetBudget(size_t budgetBytes);
+
+    // captures are only taken while enabled; disabling frees all memory of the history including the state returned by StepBack
+    // waits for a running compression; call it from the thread that captures
+    void SetEnabled(bool enabled);
+
+    // drops the whole history; needs to be called when the state changes without the emulation (loading a game or a state)
+    void Clear();
+
+    // returns the buffer to serialize the state into or nullptr if the previous capture is still getting compressed or rewind is disabled
+    uint8_t *BeginCapture(size_t stateSize);
+
+    // hands the buffer returned by BeginCapture to the worker thread
+    void EndCapture();
+
+    // steps back one state; the returned buffer stays valid until the next capture or until the buffer gets disabled
+    const uint8_t *StepBack(size_t &stateSize);
+
+    size_t UsedBytes();
+
+    size_t StateCount();
+
+private:
+    struct Entry {
+        size_t offset;
+        size_t size;
+    };
+
+    // ring of compressed deltas, the oldest entry is at the front
+    std::vector<uint8_t> ring;
+    std::deque<Entry> entries;
+    size_t head = 0;
+    size_t budget = 0;
+    bool enabled = false;
+
+    // newest state and the one getting captured
+    std::vector<uint8_t> latest;
+    std::vector<uint8_t> capture;
+    std::vector<uint8_t> encodeBuffer;
+
+    std::thread workerThread;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool pending = false;
+    bool running = false;
+
+    void WorkerLoop();
+
+    size_t Encode();
+
+    void Store(const uint8_t *data, size_t size);
+
+    void WaitIdle(std::unique_lock<std::mutex> &lock);
+
+    void FreeMemory();
+};
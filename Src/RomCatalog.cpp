@@ -0,0 +1,290 @@
+#include "RomCatalog.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <dirent.h>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <OVR_LogUtils.h>
+
+namespace {
+
+void WriteValue(std::ofstream &file, const void *value, size_t size) {
+    file.write((const char *) value, size);
+}
+
+void WriteString(std::ofstream &file, const std::string &value) {
+    uint32_t length = (uint32_t) value.size();
+    WriteValue(file, &length, sizeof(length));
+    file.write(value.data(), length);
+}
+
+bool ReadValue(std::ifstream &file, void *value, size_t size) {
+    return (bool) file.read((char *) value, size);
+}
+
+// counts come straight from the file; a corrupt count could otherwise allocate far more than the file holds
+bool FitsInFile(std::ifstream &file, uint64_t fileSize, uint64_t count, uint64_t minItemSize) {
+    std::streamoff position = file.tellg();
+    return position >= 0 && (uint64_t) position <= fileSize && count <= (fileSize - position) / minItemSize;
+}
+
+bool ReadString(std::ifstream &file, uint64_t fileSize, std::string &value) {
+    uint32_t length;
+    if (!ReadValue(file, &length, sizeof(length)) || length > 4096 || !FitsInFile(file, fileSize, length, 1))
+        return false;
+    value.resize(length);
+    return (bool) file.read(&value[0], length);
+}
+
+// smallest size of a folder and an entry in the file: every string takes at least its length
+const uint64_t MinFolderSize = sizeof(uint32_t) + sizeof(int64_t) + sizeof(uint32_t) * 2;
+const uint64_t MinEntrySize = sizeof(uint32_t) * 2 + sizeof(uint64_t) + sizeof(int64_t);
+
+}
+
+void RomCatalog::Init(const std::string &_catalogPath, const std::string &_romPath, const std::vector<std::string> &_extensions) {
+    catalogPath = _catalogPath;
+    romPath = _romPath;
+    extensions = _extensions;
+
+    if (!ReadCatalog()) {
+        OVR_LOG("no rom catalog at %s", catalogPath.c_str());
+        folders.clear();
+    }
+    Publish();
+    listChanged = false;
+
+    running = true;
+    scanThread = std::thread(&RomCatalog::ScanLoop, this);
+}
+
+void RomCatalog::Shutdown() {
+    if (!scanThread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    condition.notify_all();
+    scanThread.join();
+}
+
+std::shared_ptr<const RomCatalog::EntryList> RomCatalog::List() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return list;
+}
+
+void RomCatalog::Scan() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        scanRequested = true;
+    }
+    condition.notify_all();
+}
+
+std::shared_ptr<const RomCatalog::EntryList> RomCatalog::TakeUpdate() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!listChanged)
+        return nullptr;
+
+    listChanged = false;
+    return list;
+}
+
+void RomCatalog::ScanLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        condition.wait(lock, [this] { return scanRequested || !running; });
+        if (!running)
+            break;
+        scanRequested = false;
+
+        lock.unlock();
+        std::vector<Folder> scanned;
+        bool changed = ScanFolder(romPath, scanned);
+        // a folder got removed
+        if (scanned.size() != folders.size())
+            changed = true;
+        folders.swap(scanned);
+
+        if (changed) {
+            OVR_LOG("rom catalog changed");
+            Publish();
+            WriteCatalog();
+        }
+        lock.lock();
+    }
+}
+
+// folders that did not change keep their entries; their subfolders still get checked
+bool RomCatalog::ScanFolder(const std::string &path, std::vector<Folder> &scanned) {
+    struct stat folderStat;
+    if (stat(path.c_str(), &folderStat) != 0 || !S_ISDIR(folderStat.st_mode)) {
+        OVR_LOG("could not open folder %s", path.c_str());
+        return false;
+    }
+
+    const Folder *known = nullptr;
+    for (const Folder &folder : folders)
+        if (folder.path == path)
+            known = &folder;
+
+    Folder folder;
+    folder.path = path;
+    folder.modified = (int64_t) folderStat.st_mtime;
+    bool changed = known == nullptr || known->modified != folder.modified;
+
+    if (!changed) {
+        folder.subfolders = known->subfolders;
+        folder.entries = known->entries;
+    } else {
+        DIR *dir = opendir(path.c_str());
+        if (dir == nullptr)
+            return false;
+
+        struct dirent *ent;
+        while ((ent = readdir(dir)) != nullptr) {
+            std::string fileName = ent->d_name;
+            if (fileName.empty() || fileName[0] == '.')
+                continue;
+
+            std::string fullPath = path + fileName;
+            struct stat fileStat;
+            if (stat(fullPath.c_str(), &fileStat) != 0)
+                continue;
+
+            if (S_ISDIR(fileStat.st_mode)) {
+                folder.subfolders.push_back(fileName);
+            } else if (S_ISREG(fileStat.st_mode) && IsRom(fileName)) {
+                folder.entries.push_back({fullPath, fileName.substr(0, fileName.find_last_of('.')), (uint64_t) fileStat.st_size,
+                                          (int64_t) fileStat.st_mtime});
+            }
+        }
+        closedir(dir);
+    }
+
+    std::vector<std::string> subfolders = folder.subfolders;
+    scanned.push_back(folder);
+    for (const std::string &subfolder : subfolders)
+        changed |= ScanFolder(path + subfolder + "/", scanned);
+
+    return changed;
+}
+
+bool RomCatalog::IsRom(const std::string &fileName) const {
+    for (const std::string &extension : extensions) {
+        if (fileName.size() > extension.size() &&
+            fileName.compare(fileName.size() - extension.size(), extension.size(), extension) == 0)
+            return true;
+    }
+    return false;
+}
+
+// the list gets replaced as a whole so readers never see a partly updated list
+void RomCatalog::Publish() {
+    std::shared_ptr<EntryList> newList = std::make_shared<EntryList>();
+    for (const Folder &folder : folders)
+        newList->insert(newList->end(), folder.entries.begin(), folder.entries.end());
+
+    std::sort(newList->begin(), newList->end(), [](const Entry &first, const Entry &second) {
+        return first.name < second.name;
+    });
+
+    std::lock_guard<std::mutex> lock(mutex);
+    list = newList;
+    listChanged = true;
+}
+
+bool RomCatalog::ReadCatalog() {
+    std::ifstream file(catalogPath, std::ios::in | std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+        return false;
+
+    std::streamoff end = file.tellg();
+    file.seekg(0, std::ios::beg);
+    if (end < 0)
+        return false;
+    uint64_t fileSize = (uint64_t) end;
+
+    // a catalog that does not fit its counts is corrupt and leads to a full scan
+    uint32_t magic, version, folderCount;
+    if (!ReadValue(file, &magic, sizeof(magic)) || !ReadValue(file, &version, sizeof(version)) ||
+        !ReadValue(file, &folderCount, sizeof(folderCount)) || magic != Magic || version != Version ||
+        !FitsInFile(file, fileSize, folderCount, MinFolderSize))
+        return false;
+
+    folders.resize(folderCount);
+    for (Folder &folder : folders) {
+        uint32_t subfolderCount, entryCount;
+        if (!ReadString(file, fileSize, folder.path) || !ReadValue(file, &folder.modified, sizeof(folder.modified)) ||
+            !ReadValue(file, &subfolderCount, sizeof(subfolderCount)) || !FitsInFile(file, fileSize, subfolderCount, sizeof(uint32_t)))
+            return false;
+
+        folder.subfolders.resize(subfolderCount);
+        for (std::string &subfolder : folder.subfolders)
+            if (!ReadString(file, fileSize, subfolder))
+                return false;
+
+        if (!ReadValue(file, &entryCount, sizeof(entryCount)) || !FitsInFile(file, fileSize, entryCount, MinEntrySize))
+            return false;
+
+        folder.entries.resize(entryCount);
+        for (Entry &entry : folder.entries) {
+            if (!ReadString(file, fileSize, entry.path) || !ReadString(file, fileSize, entry.name) ||
+                !ReadValue(file, &entry.size, sizeof(entry.size)) || !ReadValue(file, &entry.modified, sizeof(entry.modified)))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+// the catalog is only a cache; a lost write just leads to a full scan
+// the old catalog only gets replaced if the new one was written completely
+void RomCatalog::WriteCatalog() {
+    std::string tempPath = catalogPath + ".tmp";
+    bool success;
+    {
+        std::ofstream file(tempPath, std::ios::trunc | std::ios::binary);
+        if (!file.is_open()) {
+            OVR_LOG("could not write rom catalog %s", tempPath.c_str());
+            return;
+        }
+
+        uint32_t magic = Magic, version = Version, folderCount = (uint32_t) folders.size();
+        WriteValue(file, &magic, sizeof(magic));
+        WriteValue(file, &version, sizeof(version));
+        WriteValue(file, &folderCount, sizeof(folderCount));
+
+        for (const Folder &folder : folders) {
+            WriteString(file, folder.path);
+            WriteValue(file, &folder.modified, sizeof(folder.modified));
+
+            uint32_t subfolderCount = (uint32_t) folder.subfolders.size();
+            WriteValue(file, &subfolderCount, sizeof(subfolderCount));
+            for (const std::string &subfolder : folder.subfolders)
+                WriteString(file, subfolder);
+
+            uint32_t entryCount = (uint32_t) folder.entries.size();
+            WriteValue(file, &entryCount, sizeof(entryCount));
+            for (const Entry &entry : folder.entries) {
+                WriteString(file, entry.path);
+                WriteString(file, entry.name);
+                WriteValue(file, &entry.size, sizeof(entry.size));
+                WriteValue(file, &entry.modified, sizeof(entry.modified));
+            }
+        }
+
+        file.close();
+        success = !file.fail();
+    }
+
+    if (!success || rename(tempPath.c_str(), catalogPath.c_str()) != 0) {
+        OVR_LOG("could not write rom catalog %s", catalogPath.c_str());
+        unlink(tempPath.c_str());
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// list of the roms that is stored between runs
+// folders only get listed again when their modification time changed; scans run on a background thread
+class RomCatalog {
+public:
+    struct Entry {
+        std::string path;
+        std::string name;
+        uint64_t size;
+        int64_t modified;
+    };
+
+    typedef std::vector<Entry> EntryList;
+
+    // reads the stored catalog
+    void Init(const std::string &_catalogPath, const std::string &_romPath, const std::vector<std::string> &_extensions);
+
+    void Shutdown();
+
+    // roms sorted by name
+    std::shared_ptr<const EntryList> List();
+
+    // checks the folders for changes on the background thread
+    void Scan();
+
+    // returns the new list if a scan found changes since the last call
+    std::shared_ptr<const EntryList> TakeUpdate();
+
+private:
+    static const uint32_t Magic = 0x43524256; // "VBRC"
+    static const uint32_t Version = 1;
+
+    struct Folder {
+        std::string path;
+        int64_t modified;
+        std::vector<std::string> subfolders;
+        std::vector<Entry> entries;
+    };
+
+    std::string catalogPath;
+    std::string romPath;
+    std::vector<std::string> extensions;
+
+    // only used by the scan thread after Init
+    std::vector<Folder> folders;
+
+    std::thread scanThread;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::shared_ptr<const EntryList> list;
+    bool listChanged = false;
+    bool scanRequested = false;
+    bool running = false;
+
+    void ScanLoop();
+
+    bool ScanFolder(const std::string &path, std::vector<Folder> &scanned);
+
+    bool IsRom(const std::string &fileName) const;
+
+    void Publish();
+
+    bool ReadCatalog();
+
+    void WriteCatalog();
+};
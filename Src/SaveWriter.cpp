@@ -0,0 +1,154 @@
+#include "SaveWriter.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <OVR_LogUtils.h>
+
+void SaveWriter::Init() {
+    running = true;
+    workerThread = std::thread(&SaveWriter::WorkerLoop, this);
+}
+
+void SaveWriter::Shutdown() {
+    if (!workerThread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    condition.notify_all();
+    workerThread.join();
+
+    for (std::vector<uint8_t> *buffer : bufferPool)
+        delete buffer;
+    bufferPool.clear();
+}
+
+std::vector<uint8_t> *SaveWriter::AcquireBuffer() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (bufferPool.empty())
+        return new std::vector<uint8_t>();
+
+    std::vector<uint8_t> *buffer = bufferPool.back();
+    bufferPool.pop_back();
+    return buffer;
+}
+
+void SaveWriter::ReleaseBuffer(std::vector<uint8_t> *buffer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    bufferPool.push_back(buffer);
+}
+
+void SaveWriter::Write(const std::string &path, std::vector<uint8_t> *buffer, int tag, WriteFunction writeFunction) {
+    Queue(path, buffer, tag, [path, writeFunction](const std::vector<uint8_t> &data) {
+        return WriteFile(path, data, writeFunction);
+    });
+}
+
+void SaveWriter::Queue(const std::string &path, std::vector<uint8_t> *buffer, int tag, Task task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back({path, buffer, tag, task});
+    }
+    condition.notify_all();
+}
+
+void SaveWriter::Flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this] { return jobs.empty() && !busy; });
+}
+
+bool SaveWriter::PopResult(Result &result) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (results.empty())
+        return false;
+
+    result = results.front();
+    results.pop_front();
+    return true;
+}
+
+// the queue gets emptied before the thread stops so no save gets lost
+void SaveWriter::WorkerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        condition.wait(lock, [this] { return !jobs.empty() || !running; });
+        if (jobs.empty())
+            break;
+
+        Job job = jobs.front();
+        jobs.pop_front();
+        busy = true;
+
+        lock.unlock();
+        bool success = job.task(*job.buffer);
+        lock.lock();
+
+        bufferPool.push_back(job.buffer);
+        results.push_back({job.tag, success, job.path});
+        busy = false;
+        condition.notify_all();
+    }
+}
+
+bool SaveWriter::WriteAll(int file, const void *data, size_t size) {
+    const uint8_t *bytes = (const uint8_t *) data;
+    size_t written = 0;
+    while (written < size) {
+        ssize_t result = write(file, bytes + written, size - written);
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        written += result;
+    }
+    return true;
+}
+
+bool SaveWriter::WriteFile(const std::string &path, const std::vector<uint8_t> &data, const WriteFunction &writeFunction) {
+    std::string tempPath = path + ".tmp";
+
+    int file = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file < 0) {
+        OVR_LOG("could not open %s: %s", tempPath.c_str(), strerror(errno));
+        return false;
+    }
+
+    bool success = writeFunction ? writeFunction(file, data) : WriteAll(file, data.data(), data.size());
+    success = success && fsync(file) == 0;
+    if (!success)
+        OVR_LOG("could not write %s: %s", tempPath.c_str(), strerror(errno));
+
+    if (close(file) != 0)
+        success = false;
+
+    if (!success || rename(tempPath.c_str(), path.c_str()) != 0) {
+        OVR_LOG("could not replace %s", path.c_str());
+        unlink(tempPath.c_str());
+        return false;
+    }
+
+    // sync the directory so the rename itself survives a crash
+    SyncFolder(path);
+    return true;
+}
+
+bool SaveWriter::SyncFolder(const std::string &path) {
+    size_t folderEnd = path.find_last_of('/');
+    if (folderEnd == std::string::npos)
+        return true;
+
+    int folder = open(path.substr(0, folderEnd).c_str(), O_RDONLY | O_DIRECTORY);
+    if (folder < 0)
+        return false;
+
+    bool success = fsync(folder) == 0;
+    close(folder);
+    return success;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// writes files on a background thread
+// the data goes to a temporary file that gets synced and renamed over the target so a crash never leaves a half written file
+class SaveWriter {
+public:
+    struct Result {
+        int tag;
+        bool success;
+        std::string path;
+    };
+
+    // writes the data into the open file; by default the data gets written as it is
+    typedef std::function<bool(int file, const std::vector<uint8_t> &data)> WriteFunction;
+
+    // does the whole write itself; used for files that get updated in place
+    typedef std::function<bool(const std::vector<uint8_t> &data)> Task;
+
+    void Init();
+
+    // writes all queued files before returning
+    void Shutdown();
+
+    // buffers come from a pool and go back into it after they got written
+    std::vector<uint8_t> *AcquireBuffer();
+
+    void ReleaseBuffer(std::vector<uint8_t> *buffer);
+
+    // takes ownership of the buffer; the tag is handed back with the result
+    void Write(const std::string &path, std::vector<uint8_t> *buffer, int tag, WriteFunction writeFunction = nullptr);
+
+    void Queue(const std::string &path, std::vector<uint8_t> *buffer, int tag, Task task);
+
+    // waits until all queued files are written
+    void Flush();
+
+    // results of the finished writes in the order they got queued
+    bool PopResult(Result &result);
+
+    static bool WriteAll(int file, const void *data, size_t size);
+
+    // syncs the folder of the path so a created, renamed or deleted file survives a crash
+    static bool SyncFolder(const std::string &path);
+
+private:
+    struct Job {
+        std::string path;
+        std::vector<uint8_t> *buffer;
+        int tag;
+        Task task;
+    };
+
+    std::thread workerThread;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<Job> jobs;
+    std::deque<Result> results;
+    std::vector<std::vector<uint8_t> *> bufferPool;
+    bool busy = false;
+    bool running = false;
+
+    void WorkerLoop();
+
+    static bool WriteFile(const std::string &path, const std::vector<uint8_t> &data, const WriteFunction &writeFunction);
+};
@@ -0,0 +1,312 @@
+#include "SlotContainer.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <OVR_LogUtils.h>
+
+#include "MappedFile.h"
+#include "SaveWriter.h"
+#include "StateFile.h"
+
+namespace {
+
+bool ReadAll(int file, uint64_t offset, void *data, size_t size) {
+    uint8_t *bytes = (uint8_t *) data;
+    size_t done = 0;
+    while (done < size) {
+        ssize_t result = pread(file, bytes + done, size - done, offset + done);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0)
+            return false;
+        done += result;
+    }
+    return true;
+}
+
+bool WriteAllAt(int file, uint64_t offset, const void *data, size_t size) {
+    const uint8_t *bytes = (const uint8_t *) data;
+    size_t done = 0;
+    while (done < size) {
+        ssize_t result = pwrite(file, bytes + done, size - done, offset + done);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0)
+            return false;
+        done += result;
+    }
+    return true;
+}
+
+}
+
+SlotContainer::~SlotContainer() {
+    CloseFile();
+}
+
+void SlotContainer::Open(const std::string &_path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    CloseFile();
+    path = _path;
+    ResetIndex();
+
+    file = open(path.c_str(), O_RDWR);
+    if (file < 0)
+        return;
+
+    // use the newer of the two valid index copies
+    Index first, second;
+    bool firstValid = ReadIndex(0, first);
+    bool secondValid = ReadIndex(IndexSize, second);
+    if (firstValid && (!secondValid || first.sequence > second.sequence))
+        index = first;
+    else if (secondValid)
+        index = second;
+    else
+        OVR_LOG("slot container %s has no valid index", path.c_str());
+}
+
+void SlotContainer::Close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    CloseFile();
+}
+
+void SlotContainer::CloseFile() {
+    if (file >= 0)
+        close(file);
+    file = -1;
+}
+
+bool SlotContainer::HasState(int slot) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return index.slots[slot].stateSize > 0;
+}
+
+bool SlotContainer::HasImage(int slot) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return index.slots[slot].imageSize > 0;
+}
+
+bool SlotContainer::ReadState(int slot, uint32_t romCrc, size_t stateSize, std::vector<uint8_t> &state) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file < 0 || index.slots[slot].stateSize == 0)
+        return false;
+
+    MappedFile mappedState;
+    if (!mappedState.Map(file, index.slots[slot].stateOffset, index.slots[slot].stateSize))
+        return false;
+
+    return StateFile::Read(mappedState.Data(), mappedState.Size(), romCrc, stateSize, state);
+}
+
+bool SlotContainer::ReadImage(int slot, uint8_t *image, size_t imageSize) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file < 0 || index.slots[slot].imageSize != imageSize)
+        return false;
+
+    return ReadAll(file, index.slots[slot].imageOffset, image, imageSize);
+}
+
+bool SlotContainer::WriteSlot(int slot, const uint8_t *state, size_t stateSize, uint32_t romCrc, const uint8_t *image, size_t imageSize) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return StoreSlot(slot, state, stateSize, romCrc, image, imageSize);
+}
+
+int SlotContainer::ImportLegacySlots(const std::string &legacyPath, uint32_t romCrc, size_t stateSize, size_t imageSize) {
+    std::lock_guard<std::mutex> lock(mutex);
+    // the slot files were imported when the container got created
+    if (file >= 0)
+        return 0;
+
+    std::vector<std::string> importedFiles;
+
+    for (int slot = 0; slot < SlotCount; ++slot) {
+        if (index.slots[slot].stateSize > 0)
+            continue;
+
+        std::string slotSuffix = slot > 0 ? std::to_string(slot) : "";
+        std::string statePath = legacyPath + ".state" + slotSuffix;
+        std::string imagePath = legacyPath + ".stateimg" + slotSuffix;
+
+        MappedFile stateFile;
+        if (!stateFile.Open(statePath))
+            continue;
+        if (stateFile.Size() != stateSize) {
+            OVR_LOG("%s does not have the size of a state, it does not get imported", statePath.c_str());
+            continue;
+        }
+
+        // the slot gets imported without its image if the image is missing
+        MappedFile imageFile;
+        bool hasImage = imageFile.Open(imagePath) && imageFile.Size() == imageSize;
+        if (!StoreSlot(slot, stateFile.Data(), stateSize, romCrc, hasImage ? imageFile.Data() : nullptr, hasImage ? imageSize : 0)) {
+            OVR_LOG("could not import %s", statePath.c_str());
+            continue;
+        }
+
+        importedFiles.push_back(statePath);
+        importedFiles.push_back(imagePath);
+    }
+
+    // the container gets created even without imported slots so the old files are not searched again
+    if (importedFiles.empty()) {
+        if (CreateFile() && !SaveWriter::SyncFolder(path))
+            OVR_LOG("could not sync the folder of %s", path.c_str());
+        return 0;
+    }
+
+    // the slot data and the index are synced by StoreSlot; the container file itself could be new
+    if (!SaveWriter::SyncFolder(path)) {
+        OVR_LOG("could not sync the folder of %s, keeping the old slot files", path.c_str());
+        return (int) importedFiles.size() / 2;
+    }
+
+    for (const std::string &importedFile : importedFiles)
+        unlink(importedFile.c_str());
+
+    OVR_LOG("imported %zu slots into %s", importedFiles.size() / 2, path.c_str());
+    return (int) importedFiles.size() / 2;
+}
+
+bool SlotContainer::StoreSlot(int slot, const uint8_t *state, size_t stateSize, uint32_t romCrc, const uint8_t *image, size_t imageSize) {
+    if (file < 0 && !CreateFile())
+        return false;
+
+    off_t end = lseek(file, 0, SEEK_END);
+    if (end < (off_t) DataOffset)
+        end = lseek(file, DataOffset, SEEK_SET);
+    if (end < 0)
+        return false;
+
+    // the slot data needs to be on the disk before the index points to it
+    if (!StateFile::Write(file, state, stateSize, romCrc))
+        return false;
+    off_t imageOffset = lseek(file, 0, SEEK_CUR);
+    if (!SaveWriter::WriteAll(file, image, imageSize) || fsync(file) != 0) {
+        OVR_LOG("could not write slot %i to %s", slot, path.c_str());
+        return false;
+    }
+
+    Slot previous = index.slots[slot];
+    Slot &entry = index.slots[slot];
+    entry.stateOffset = end;
+    entry.stateSize = (uint32_t) (imageOffset - end);
+    entry.imageOffset = imageOffset;
+    entry.imageSize = (uint32_t) imageSize;
+    if (!WriteIndex()) {
+        index.slots[slot] = previous;
+        return false;
+    }
+
+    // replaced slots stay in the file until it gets compacted
+    uint64_t fileSize = imageOffset + imageSize;
+    if (fileSize > DataOffset + UsedBytes() * 2)
+        Compact();
+
+    return true;
+}
+
+// creates the file with the current index
+bool SlotContainer::CreateFile() {
+    file = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (file < 0) {
+        OVR_LOG("could not create %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    return WriteIndex();
+}
+
+void SlotContainer::ResetIndex() {
+    memset(&index, 0, sizeof(index));
+    index.magic = Magic;
+    index.version = Version;
+}
+
+bool SlotContainer::ReadIndex(uint64_t offset, Index &readIndex) {
+    if (!ReadAll(file, offset, &readIndex, sizeof(readIndex)))
+        return false;
+
+    return readIndex.magic == Magic && readIndex.version == Version && readIndex.crc == IndexCrc(readIndex);
+}
+
+// the copy that gets written alternates with the sequence number
+bool SlotContainer::WriteIndex() {
+    index.sequence++;
+    index.crc = IndexCrc(index);
+
+    uint64_t offset = (index.sequence % 2) * IndexSize;
+    if (!WriteAllAt(file, offset, &index, sizeof(index)) || fsync(file) != 0) {
+        OVR_LOG("could not write the index of %s", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+uint64_t SlotContainer::UsedBytes() const {
+    uint64_t used = 0;
+    for (int i = 0; i < SlotCount; ++i)
+        used += index.slots[i].stateSize + index.slots[i].imageSize;
+    return used;
+}
+
+// copies the used slots into a new file that replaces the old one
+bool SlotContainer::Compact() {
+    std::string tempPath = path + ".tmp";
+    int newFile = open(tempPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (newFile < 0)
+        return false;
+
+    Index newIndex = index;
+    newIndex.sequence = 0;
+    uint64_t offset = DataOffset;
+    std::vector<uint8_t> buffer;
+    bool success = true;
+
+    for (int i = 0; i < SlotCount && success; ++i) {
+        Slot &entry = newIndex.slots[i];
+        if (entry.stateSize == 0 && entry.imageSize == 0)
+            continue;
+
+        // state and image are stored next to each other
+        size_t size = entry.stateSize + entry.imageSize;
+        buffer.resize(size);
+        success = ReadAll(file, entry.stateOffset, buffer.data(), entry.stateSize) &&
+                  ReadAll(file, entry.imageOffset, buffer.data() + entry.stateSize, entry.imageSize) &&
+                  WriteAllAt(newFile, offset, buffer.data(), size);
+
+        entry.stateOffset = offset;
+        entry.imageOffset = offset + entry.stateSize;
+        offset += size;
+    }
+
+    // both index copies get written so the new file does not start with an old copy
+    newIndex.crc = IndexCrc(newIndex);
+    success = success && WriteAllAt(newFile, 0, &newIndex, sizeof(newIndex)) &&
+              WriteAllAt(newFile, IndexSize, &newIndex, sizeof(newIndex)) && fsync(newFile) == 0;
+
+    if (!success || rename(tempPath.c_str(), path.c_str()) != 0) {
+        OVR_LOG("could not compact %s", path.c_str());
+        close(newFile);
+        unlink(tempPath.c_str());
+        return false;
+    }
+
+    // the rename only survives a crash once the folder is synced
+    if (!SaveWriter::SyncFolder(path))
+        OVR_LOG("could not sync the folder of %s", path.c_str());
+
+    close(file);
+    file = newFile;
+    index = newIndex;
+    return true;
+}
+
+uint32_t SlotContainer::IndexCrc(const Index &crcIndex) {
+    Index copy = crcIndex;
+    copy.crc = 0;
+    return StateFile::Crc32(0, (const uint8_t *) &copy, sizeof(copy));
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// all save slots of a rom with their images in one file
+// the front of the file holds two copies of the slot index; an update appends the slot data and then overwrites
+// the older index copy so the other copy stays valid if the write gets interrupted
+// the file gets compacted once the space of replaced slots gets too big
+// all functions can be called from any thread
+class SlotContainer {
+public:
+    static const int SlotCount = 10;
+
+    ~SlotContainer();
+
+    // opens the file and reads the index; a missing or broken file is an empty container
+    void Open(const std::string &path);
+
+    void Close();
+
+    bool HasState(int slot);
+
+    bool HasImage(int slot);
+
+    bool ReadState(int slot, uint32_t romCrc, size_t stateSize, std::vector<uint8_t> &state);
+
+    bool ReadImage(int slot, uint8_t *image, size_t imageSize);
+
+    // stores the state in the state file format together with the image
+    bool WriteSlot(int slot, const uint8_t *state, size_t stateSize, uint32_t romCrc, const uint8_t *image, size_t imageSize);
+
+    // moves the slots older versions saved as single files (legacyPath + ".state" and ".stateimg", with the slot number for
+    // slots above 0) into the empty slots; the old files only get deleted after the container is synced
+    // this only happens once: the container file gets created by the import and the import is skipped if the file exists
+    // returns the number of imported slots
+    int ImportLegacySlots(const std::string &legacyPath, uint32_t romCrc, size_t stateSize, size_t imageSize);
+
+private:
+    static const uint32_t Magic = 0x43534256; // "VBSC"
+    static const uint32_t Version = 1;
+    // space reserved for each index copy; the slot data starts behind both copies
+    static const uint64_t IndexSize = 512;
+    static const uint64_t DataOffset = IndexSize * 2;
+
+    struct Slot {
+        uint64_t stateOffset;
+        uint64_t imageOffset;
+        uint32_t stateSize;
+        uint32_t imageSize;
+    };
+
+    struct Index {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t sequence;
+        uint32_t crc;
+        Slot slots[SlotCount];
+    };
+
+    static_assert(sizeof(Index) <= IndexSize, "the index does not fit into its space");
+
+    std::mutex mutex;
+    std::string path;
+    int file = -1;
+    Index index;
+
+    void CloseFile();
+
+    // needs to hold the mutex
+    bool CreateFile();
+
+    void ResetIndex();
+
+    // needs to hold the mutex
+    bool StoreSlot(int slot, const uint8_t *state, size_t stateSize, uint32_t romCrc, const uint8_t *image, size_t imageSize);
+
+    bool ReadIndex(uint64_t offset, Index &readIndex);
+
+    bool WriteIndex();
+
+    uint64_t UsedBytes() const;
+
+    bool Compact();
+
+    static uint32_t IndexCrc(const Index &crcIndex);
+};
@@ -0,0 +1,260 @@
+#include "StateFile.h"
+
+#include <cstring>
+
+#include <OVR_LogUtils.h>
+
+#include "SaveWriter.h"
+
+namespace {
+
+// blocks that do not get smaller are stored uncompressed
+const uint32_t RawBlockFlag = 0x80000000;
+
+const int MinMatch = 4;
+const int HashBits = 12;
+// the last bytes of a block are always literals so the match search does not need to check the end
+const size_t LastLiterals = 5;
+
+uint32_t Read32(const uint8_t *data) {
+    uint32_t value;
+    memcpy(&value, data, 4);
+    return value;
+}
+
+uint32_t Hash(uint32_t value) {
+    return (value * 2654435761u) >> (32 - HashBits);
+}
+
+void WriteLength(uint8_t *&out, size_t length) {
+    while (length >= 255) {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = (uint8_t) length;
+}
+
+bool ReadLength(const uint8_t *&in, const uint8_t *end, size_t &length) {
+    uint8_t value;
+    do {
+        if (in >= end)
+            return false;
+        value = *in++;
+        length += value;
+    } while (value == 255);
+    return true;
+}
+
+// sequence: token (literal length << 4 | match length - 4), literals, 16 bit match offset
+// lengths of 15 continue in the following bytes; the last sequence only has literals
+void WriteSequence(uint8_t *&out, const uint8_t *literals, size_t literalLength, size_t offset, size_t matchLength) {
+    uint8_t *token = out++;
+    *token = (uint8_t) ((literalLength >= 15 ? 15 : literalLength) << 4);
+    if (literalLength >= 15)
+        WriteLength(out, literalLength - 15);
+    memcpy(out, literals, literalLength);
+    out += literalLength;
+
+    if (matchLength == 0)
+        return;
+
+    *out++ = (uint8_t) offset;
+    *out++ = (uint8_t) (offset >> 8);
+
+    matchLength -= MinMatch;
+    *token |= (uint8_t) (matchLength >= 15 ? 15 : matchLength);
+    if (matchLength >= 15)
+        WriteLength(out, matchLength - 15);
+}
+
+// copies the value and moves the data pointer; fails instead of reading past the end
+bool ReadValue(const uint8_t *&data, const uint8_t *end, void *value, size_t size) {
+    if (size > (size_t) (end - data))
+        return false;
+
+    memcpy(value, data, size);
+    data += size;
+    return true;
+}
+
+}
+
+uint32_t StateFile::Crc32(uint32_t crc, const uint8_t *data, size_t size) {
+    static const std::vector<uint32_t> table = [] {
+        std::vector<uint32_t> values(256);
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; ++bit)
+                value = (value & 1) ? (value >> 1) ^ 0xEDB88320 : value >> 1;
+            values[i] = value;
+        }
+        return values;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+size_t StateFile::CompressBlock(const uint8_t *input, size_t inputSize, uint8_t *output) {
+    uint32_t table[1 << HashBits];
+    memset(table, 0xFF, sizeof(table));
+
+    uint8_t *out = output;
+    size_t anchor = 0;
+    size_t position = 0;
+    size_t matchLimit = inputSize > LastLiterals + MinMatch ? inputSize - LastLiterals - MinMatch : 0;
+
+    while (position < matchLimit) {
+        uint32_t value = Read32(input + position);
+        uint32_t hash = Hash(value);
+        uint32_t reference = table[hash];
+        table[hash] = (uint32_t) position;
+
+        if (reference == 0xFFFFFFFF || position - reference > 0xFFFF || Read32(input + reference) != value) {
+            position++;
+            continue;
+        }
+
+        size_t matchLength = MinMatch;
+        while (position + matchLength < inputSize - LastLiterals && input[reference + matchLength] == input[position + matchLength])
+            matchLength++;
+
+        WriteSequence(out, input + anchor, position - anchor, position - reference, matchLength);
+        position += matchLength;
+        anchor = position;
+    }
+
+    WriteSequence(out, input + anchor, inputSize - anchor, 0, 0);
+    return out - output;
+}
+
+bool StateFile::DecompressBlock(const uint8_t *input, size_t inputSize, uint8_t *output, size_t outputSize) {
+    const uint8_t *in = input;
+    const uint8_t *end = input + inputSize;
+    size_t position = 0;
+
+    while (in < end) {
+        uint8_t token = *in++;
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !ReadLength(in, end, literalLength))
+            return false;
+        if (literalLength > (size_t) (end - in) || literalLength > outputSize - position)
+            return false;
+        memcpy(output + position, in, literalLength);
+        in += literalLength;
+        position += literalLength;
+
+        // the last sequence has no match
+        if (in == end)
+            break;
+
+        if (end - in < 2)
+            return false;
+        size_t offset = in[0] | (in[1] << 8);
+        in += 2;
+        if (offset == 0 || offset > position)
+            return false;
+
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !ReadLength(in, end, matchLength))
+            return false;
+        matchLength += MinMatch;
+        if (matchLength > outputSize - position)
+            return false;
+
+        // the match can overlap with the bytes it produces
+        for (size_t i = 0; i < matchLength; ++i, ++position)
+            output[position] = output[position - offset];
+    }
+
+    return position == outputSize;
+}
+
+bool StateFile::Write(int file, const uint8_t *state, size_t stateSize, uint32_t romCrc) {
+    Header header = {Magic, Version, romCrc, (uint32_t) stateSize};
+    if (!SaveWriter::WriteAll(file, &header, sizeof(header)))
+        return false;
+
+    std::vector<uint8_t> block(MaxCompressedSize(BlockSize));
+    for (size_t position = 0; position < stateSize; position += BlockSize) {
+        size_t size = stateSize - position < BlockSize ? stateSize - position : BlockSize;
+        size_t compressedSize = CompressBlock(state + position, size, block.data());
+
+        uint32_t blockHeader = (uint32_t) compressedSize;
+        const uint8_t *blockData = block.data();
+        if (compressedSize >= size) {
+            blockHeader = (uint32_t) size | RawBlockFlag;
+            blockData = state + position;
+            compressedSize = size;
+        }
+
+        if (!SaveWriter::WriteAll(file, &blockHeader, sizeof(blockHeader)) || !SaveWriter::WriteAll(file, blockData, compressedSize))
+            return false;
+    }
+
+    uint32_t crc = Crc32(0, state, stateSize);
+    return SaveWriter::WriteAll(file, &crc, sizeof(crc));
+}
+
+bool StateFile::Read(const uint8_t *data, size_t length, uint32_t romCrc, size_t stateSize, std::vector<uint8_t> &state) {
+    const uint8_t *end = data + length;
+
+    // states of older versions are the raw serialized state without a header; they can not be checked against the rom
+    uint32_t magic = 0;
+    if (length >= sizeof(magic))
+        memcpy(&magic, data, sizeof(magic));
+    if (magic != Magic && length == stateSize && stateSize > 0) {
+        OVR_LOG("loading a state without header");
+        state.assign(data, data + length);
+        return true;
+    }
+
+    Header header;
+    if (!ReadValue(data, end, &header, sizeof(header)) || header.magic != Magic || header.version != Version) {
+        OVR_LOG("state is not of version %u", Version);
+        return false;
+    }
+    if (header.romCrc != romCrc || header.stateSize != stateSize) {
+        OVR_LOG("state is from a different game (crc %08x, size %u)", header.romCrc, header.stateSize);
+        return false;
+    }
+
+    // the blocks get decompressed straight from the file data
+    state.resize(stateSize);
+    uint32_t crc = 0;
+
+    for (size_t position = 0; position < stateSize; position += BlockSize) {
+        size_t size = stateSize - position < BlockSize ? stateSize - position : BlockSize;
+
+        uint32_t blockHeader;
+        if (!ReadValue(data, end, &blockHeader, sizeof(blockHeader)))
+            return false;
+
+        size_t compressedSize = blockHeader & ~RawBlockFlag;
+        if ((blockHeader & RawBlockFlag) ? compressedSize != size : compressedSize > MaxCompressedSize(BlockSize))
+            return false;
+        if (compressedSize > (size_t) (end - data))
+            return false;
+
+        if (blockHeader & RawBlockFlag) {
+            memcpy(&state[position], data, size);
+        } else if (!DecompressBlock(data, compressedSize, &state[position], size)) {
+            OVR_LOG("state block at %zu is corrupt", position);
+            return false;
+        }
+        data += compressedSize;
+
+        crc = Crc32(crc, &state[position], size);
+    }
+
+    uint32_t fileCrc;
+    if (!ReadValue(data, end, &fileCrc, sizeof(fileCrc)) || fileCrc != crc) {
+        OVR_LOG("state checksum does not match");
+        return false;
+    }
+
+    return true;
+}
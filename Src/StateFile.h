@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// save state files: a header, the state compressed in blocks and a checksum of the state
+// the blocks get compressed one at a time so only one block needs to be buffered
+class StateFile {
+public:
+    static const uint32_t Magic = 0x54534256; // "VBST"
+    static const uint32_t Version = 1;
+    static const size_t BlockSize = 64 * 1024;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t romCrc;
+        uint32_t stateSize;
+    };
+
+    // writes the state at the current position of the file
+    static bool Write(int file, const uint8_t *state, size_t stateSize, uint32_t romCrc);
+
+    // reads the state from the data of a state file; a headerless state of the right size is taken as it is
+    // fails if it is not a state of the rom, has a different size or is corrupt
+    static bool Read(const uint8_t *data, size_t length, uint32_t romCrc, size_t stateSize, std::vector<uint8_t> &state);
+
+    static uint32_t Crc32(uint32_t crc, const uint8_t *data, size_t size);
+
+    // lz block compression; the output needs to have space for MaxCompressedSize bytes
+    static size_t CompressBlock(const uint8_t *input, size_t inputSize, uint8_t *output);
+
+    static bool DecompressBlock(const uint8_t *input, size_t inputSize, uint8_t *output, size_t outputSize);
+
+    static size_t MaxCompressedSize(size_t inputSize) { return inputSize + inputSize / 255 + 16; }
+};
@@ -0,0 +1,132 @@
+#include "ThumbnailCache.h"
+
+#include <algorithm>
+#include <cstring>
+
+void ThumbnailCache::Init(size_t _imageSize, int _capacity, LoadFunction _loadFunction) {
+    imageSize = _imageSize;
+    capacity = _capacity;
+    loadFunction = _loadFunction;
+    loadBuffer.resize(imageSize);
+
+    running = true;
+    workerThread = std::thread(&ThumbnailCache::WorkerLoop, this);
+}
+
+void ThumbnailCache::Shutdown() {
+    if (!workerThread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    condition.notify_all();
+    workerThread.join();
+}
+
+void ThumbnailCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    loadQueue.clear();
+    failedSlots.clear();
+    generation++;
+}
+
+bool ThumbnailCache::Get(int slot, uint8_t *image) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry *entry = Find(slot);
+    if (entry == nullptr) {
+        QueueLoad(slot, true);
+        return false;
+    }
+
+    entry->lastUse = ++useCounter;
+    memcpy(image, entry->image.data(), imageSize);
+    return true;
+}
+
+void ThumbnailCache::Prefetch(int slot) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (Find(slot) == nullptr)
+        QueueLoad(slot, false);
+}
+
+void ThumbnailCache::Put(int slot, const uint8_t *image) {
+    std::lock_guard<std::mutex> lock(mutex);
+    failedSlots.erase(std::remove(failedSlots.begin(), failedSlots.end(), slot), failedSlots.end());
+    Insert(slot, image);
+}
+
+void ThumbnailCache::WorkerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        condition.wait(lock, [this] { return !loadQueue.empty() || !running; });
+        if (!running)
+            break;
+
+        int slot = loadQueue.front();
+        loadQueue.pop_front();
+        loadingSlot = slot;
+        int loadGeneration = generation;
+
+        lock.unlock();
+        bool loaded = loadFunction(slot, loadBuffer.data());
+        lock.lock();
+
+        loadingSlot = -1;
+        if (loadGeneration != generation)
+            continue;
+
+        // the slot could have been saved while it was loading; the saved image is newer
+        if (!loaded)
+            failedSlots.push_back(slot);
+        else if (Find(slot) == nullptr)
+            Insert(slot, loadBuffer.data());
+    }
+}
+
+ThumbnailCache::Entry *ThumbnailCache::Find(int slot) {
+    for (Entry &entry : entries)
+        if (entry.slot == slot)
+            return &entry;
+    return nullptr;
+}
+
+// replaces the least recently used image once the cache is full
+void ThumbnailCache::Insert(int slot, const uint8_t *image) {
+    Entry *entry = Find(slot);
+    if (entry == nullptr) {
+        if ((int) entries.size() < capacity) {
+            entries.push_back({slot, 0, std::vector<uint8_t>(imageSize)});
+            entry = &entries.back();
+        } else {
+            entry = &*std::min_element(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+                return a.lastUse < b.lastUse;
+            });
+            entry->slot = slot;
+        }
+    }
+
+    entry->lastUse = ++useCounter;
+    memcpy(entry->image.data(), image, imageSize);
+}
+
+// requested images get loaded before the prefetched ones; images that failed to load are not tried again
+void ThumbnailCache::QueueLoad(int slot, bool urgent) {
+    if (slot == loadingSlot || std::find(failedSlots.begin(), failedSlots.end(), slot) != failedSlots.end())
+        return;
+
+    std::deque<int>::iterator queued = std::find(loadQueue.begin(), loadQueue.end(), slot);
+    if (queued != loadQueue.end()) {
+        if (!urgent)
+            return;
+        loadQueue.erase(queued);
+    }
+
+    if (urgent)
+        loadQueue.push_front(slot);
+    else
+        loadQueue.push_back(slot);
+    condition.notify_all();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// keeps the images of the last used save slots; missing images get loaded on a background thread
+class ThumbnailCache {
+public:
+    typedef std::function<bool(int slot, uint8_t *image)> LoadFunction;
+
+    void Init(size_t _imageSize, int _capacity, LoadFunction _loadFunction);
+
+    void Shutdown();
+
+    // drops all images; loads that are still running get ignored
+    void Clear();
+
+    // copies the image into the buffer if it is cached; otherwise queues the load and returns false
+    bool Get(int slot, uint8_t *image);
+
+    // queues the load if the image is not cached
+    void Prefetch(int slot);
+
+    // sets the image of a slot that just got saved
+    void Put(int slot, const uint8_t *image);
+
+private:
+    struct Entry {
+        int slot;
+        uint64_t lastUse;
+        std::vector<uint8_t> image;
+    };
+
+    size_t imageSize;
+    int capacity;
+    LoadFunction loadFunction;
+
+    std::thread workerThread;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<Entry> entries;
+    std::deque<int> loadQueue;
+    std::vector<int> failedSlots;
+    int loadingSlot = -1;
+    std::vector<uint8_t> loadBuffer;
+    // changes with Clear so loads of the old game do not end up in the cache
+    int generation = 0;
+    uint64_t useCounter = 0;
+    bool running = false;
+
+    void WorkerLoop();
+
+    Entry *Find(int slot);
+
+    // needs to hold the mutex
+    void Insert(int slot, const uint8_t *image);
+
+    // needs to hold the mutex
+    void QueueLoad(int slot, bool urgent);
+};
@@ -0,0 +1,112 @@
+#include "TraceRecorder.h"
+
+#include <chrono>
+#include <cstdio>
+
+std::atomic<bool> TraceRecorder::enabled{true};
+std::mutex TraceRecorder::ringMutex;
+std::vector<std::unique_ptr<TraceRecorder::Ring>> TraceRecorder::rings;
+thread_local TraceRecorder::RingOwner TraceRecorder::ringOwner;
+
+TraceRecorder::RingOwner::~RingOwner() {
+    if (ring != nullptr)
+        ring->owned.store(false);
+}
+
+void TraceRecorder::SetEnabled(bool enable) {
+    enabled.store(enable);
+}
+
+bool TraceRecorder::Enabled() {
+    return enabled.load();
+}
+
+void TraceRecorder::SetThreadName(const char *name) {
+    Ring *ring = ThreadRing();
+    std::lock_guard<std::mutex> lock(ringMutex);
+    ring->threadName = name;
+}
+
+int64_t TraceRecorder::Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// the ring gets created the first time the thread records something; rings of finished threads get reused
+TraceRecorder::Ring *TraceRecorder::ThreadRing() {
+    if (ringOwner.ring != nullptr)
+        return ringOwner.ring;
+
+    std::lock_guard<std::mutex> lock(ringMutex);
+    Ring *ring = nullptr;
+    for (std::unique_ptr<Ring> &freeRing : rings) {
+        if (!freeRing->owned.load()) {
+            ring = freeRing.get();
+            break;
+        }
+    }
+
+    if (ring == nullptr) {
+        ring = new Ring();
+        ring->threadId = (int) rings.size() + 1;
+        rings.emplace_back(ring);
+    } else {
+        ring->owned.store(true);
+    }
+
+    ring->head.store(0);
+    ring->threadName = nullptr;
+    ringOwner.ring = ring;
+    return ring;
+}
+
+void TraceRecorder::Record(const char *name, int64_t start, int64_t end) {
+    Ring *ring = ThreadRing();
+    uint32_t head = ring->head.load(std::memory_order_relaxed);
+    RingEvent &event = ring->events[head % RingSize];
+    event.name.store(name, std::memory_order_relaxed);
+    event.start.store(start, std::memory_order_relaxed);
+    event.end.store(end, std::memory_order_relaxed);
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+void TraceRecorder::Dump(std::string &json) {
+    std::lock_guard<std::mutex> lock(ringMutex);
+
+    std::vector<Event> events;
+    char line[256];
+    bool first = true;
+
+    json += "{\"traceEvents\":[\n";
+    for (std::unique_ptr<Ring> &ring : rings) {
+        uint32_t head = ring->head.load(std::memory_order_acquire);
+        uint32_t begin = head > RingSize ? head - RingSize : 0;
+        events.assign(RingSize, {});
+        for (uint32_t i = begin; i < head; ++i) {
+            const RingEvent &event = ring->events[i % RingSize];
+            events[i % RingSize] = {event.name.load(std::memory_order_relaxed), event.start.load(std::memory_order_relaxed),
+                                    event.end.load(std::memory_order_relaxed)};
+        }
+
+        // the thread keeps recording while the ring gets copied; drop the events it could have overwritten
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint32_t newHead = ring->head.load(std::memory_order_relaxed);
+        if (newHead >= RingSize && newHead - RingSize + 1 > begin)
+            begin = newHead - RingSize + 1;
+
+        if (ring->threadName != nullptr) {
+            snprintf(line, sizeof(line), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                     first ? "" : ",\n", ring->threadId, ring->threadName);
+            json += line;
+            first = false;
+        }
+
+        for (uint32_t i = begin; i < head; ++i) {
+            const Event &event = events[i % RingSize];
+            snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                     first ? "" : ",\n", event.name, ring->threadId, event.start / 1000.0, (event.end - event.start) / 1000.0);
+            json += line;
+            first = false;
+        }
+    }
+    json += "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// records the start and end time of named scopes into a fixed ring per thread
+// a ring is only written by its own thread so recording takes no lock
+// Dump writes the recorded events in the chrome trace event format (chrome://tracing, ui.perfetto.dev)
+class TraceRecorder {
+public:
+    // the name needs to be a string literal, only the pointer gets stored
+    class Scope {
+    public:
+        explicit Scope(const char *name) : name(name), start(enabled.load(std::memory_order_relaxed) ? Now() : 0) {}
+
+        ~Scope() {
+            if (start != 0)
+                Record(name, start, Now());
+        }
+
+        Scope(const Scope &) = delete;
+
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        const char *name;
+        int64_t start;
+    };
+
+    static void SetEnabled(bool enable);
+
+    static bool Enabled();
+
+    // name shown for the calling thread in the trace
+    static void SetThreadName(const char *name);
+
+    // appends the events of all threads as a json trace to the string
+    static void Dump(std::string &json);
+
+private:
+    static const uint32_t RingSize = 8192;
+
+    struct Event {
+        const char *name;
+        int64_t start;
+        int64_t end;
+    };
+
+    // the fields are atomic because Dump reads them while the thread records
+    struct RingEvent {
+        std::atomic<const char *> name;
+        std::atomic<int64_t> start;
+        std::atomic<int64_t> end;
+    };
+
+    struct Ring {
+        RingEvent events[RingSize];
+        // number of events written so far; the event gets written before the count is increased
+        std::atomic<uint32_t> head{0};
+        std::atomic<bool> owned{true};
+        int threadId;
+        const char *threadName;
+    };
+
+    // frees the ring of the thread when it exits so a new thread can reuse it
+    struct RingOwner {
+        Ring *ring = nullptr;
+
+        ~RingOwner();
+    };
+
+    static std::atomic<bool> enabled;
+    static std::mutex ringMutex;
+    static std::vector<std::unique_ptr<Ring>> rings;
+    static thread_local RingOwner ringOwner;
+
+    static int64_t Now();
+
+    static Ring *ThreadRing();
+
+    static void Record(const char *name, int64_t start, int64_t end);
+};
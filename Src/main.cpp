@@ -20,7 +20,6 @@ Copyright:	Copyright (c) Facebook Technologies, LLC and its affiliates. All righ
 
 #include <FrontendGo/TextureLoader.h>
 #include <FrontendGo/Global.h>
-#include <FrontendGo/Audio/OpenSLWrap.h>
 #include <FrontendGo/DrawHelper.h>
 #include <FrontendGo/FontMaster.h>
 #include <FrontendGo/Menu.h>
@@ -38,7 +37,7 @@ long Java_com_nintendont_virtualboygo_MainActivity_nativeSetAppInterface(JNIEnv
 void Java_com_nintendont_virtualboygo_MainActivity_nativeReloadRoms(JNIEnv *jni, jclass clazz, jlong interfacePtr) {
     ALOG("nativeReloadRoms interfacePtr=%p appPtr=%p", interfacePtr, appPtr);
     if (appPtr && interfacePtr) {
-        appPtr->menuGo.ScanDirectory();
+        appPtr->ReloadRoms();
     } else {
         ALOG("nativeReloadRoms %p NULL ptr", appPtr);
     }
@@ -86,6 +85,7 @@ bool ovrVirtualBoyGo::AppInit(const OVRFW::ovrAppContext *appContext) {
     FileSys = OVRFW::ovrFileSys::Create(ctx);
 
     OVR_LOG_WITH_TAG("OvrApp", "Init");
+    TraceRecorder::SetThreadName("render");
 
     /// Init Rendering
     SurfaceRender.Init();
@@ -93,8 +93,8 @@ bool ovrVirtualBoyGo::AppInit(const OVRFW::ovrAppContext *appContext) {
     OVR::Vector3f seat = {3.0f, 0.0f, 3.6f};
     Scene.SetFootPos(seat);
 
-    OVR_LOG_WITH_TAG("OvrApp", "OpenSLWrap Init");
-    openSlWrap.Init();
+    OVR_LOG_WITH_TAG("OvrApp", "AudioOutput Init");
+    audioOutput.Init(emulator.AudioLatencyFrames);
 
     glm::mat4 projection = glm::ortho(0.0f, (float) emulator.MENU_WIDTH, 0.0f, (float) emulator.MENU_HEIGHT);
 
@@ -110,7 +110,7 @@ bool ovrVirtualBoyGo::AppInit(const OVRFW::ovrAppContext *appContext) {
     OVR_LOG_WITH_TAG("OvrApp", "romFolderPath: %s", global.romFolderPath.data());
 
     OVR_LOG_WITH_TAG("OvrApp", "Emulator Init");
-    emulator.Init(global.appStoragePath, &layerBuilder, &drawHelper, &openSlWrap);
+    emulator.Init(global.appStoragePath, &layerBuilder, &drawHelper, &audioOutput);
 
     OVR_LOG_WITH_TAG("OvrApp", "init menu");
     menuGo.Init(&emulator, &layerBuilder, &drawHelper, &fontManager, java, &clsData);
@@ -119,7 +119,7 @@ bool ovrVirtualBoyGo::AppInit(const OVRFW::ovrAppContext *appContext) {
     menuGo.LoadSettings();
 
     OVR_LOG_WITH_TAG("OvrApp", "Scan directory");
-    menuGo.ScanDirectory();
+    emulator.ScanRoms();
 
     OVR_LOG_WITH_TAG("OvrApp", "Setup MenuGo");
     menuGo.SetUpMenu();
@@ -138,35 +138,27 @@ void ovrVirtualBoyGo::InitRefreshRate() {
     std::vector<float> supportedRefreshRates(refreshRateCount);
     vrapi_GetSystemPropertyFloatArray(java, VRAPI_SYS_PROP_SUPPORTED_DISPLAY_REFRESH_RATES, supportedRefreshRates.data(), refreshRateCount);
 
-    bool setRefreshrate = false;
-    float maxRefreshrate = 0;
-    // set the refresh rate to the one requested by the emulator if it is available
-    for (int i = 0; i < refreshRateCount; ++i) {
-        OVR_LOG("Refreshrate: %f", supportedRefreshRates[i]);
-        if (supportedRefreshRates[i] > maxRefreshrate) {
-            maxRefreshrate = supportedRefreshRates[i];
-        }
-        if (supportedRefreshRates[i] == emulator.DisplayRefreshRate) {
-            setRefreshrate = true;
-
-            if (vrapi_SetDisplayRefreshRate(GetSessionObject(), emulator.DisplayRefreshRate) == ovrSuccess)
-                OVR_LOG_WITH_TAG("OvrApp", "Refreshrate set to %f", emulator.DisplayRefreshRate);
-            else
-                OVR_LOG_WITH_TAG("OvrApp", "Failed to set refreshrate");
-
-            break;
-        }
-    }
+    for (int i = 0; i < refreshRateCount; ++i)
+        OVR_LOG("Refreshrate: %f, judder %f ms", supportedRefreshRates[i], FramePacer::JudderScore(supportedRefreshRates[i], emulator.DisplayRefreshRate) * 1000);
+
+    // the refreshrate changes asynchronously, so the property would still return the old rate right after setting it
+    float displayRate = vrapi_GetSystemPropertyFloat(java, VRAPI_SYS_PROP_DISPLAY_REFRESH_RATE);
 
-    // use the highest refreshrate if the one the emulator uses does not exists
-    if (!setRefreshrate) {
-        if (refreshRateCount > 0) {
-            if (vrapi_SetDisplayRefreshRate(GetSessionObject(), maxRefreshrate) == ovrSuccess)
-                OVR_LOG_WITH_TAG("OvrApp", "Refreshrate set to max %f", maxRefreshrate);
-            else
-                OVR_LOG_WITH_TAG("OvrApp", "Failed to set refreshrate");
-        }
+    // use the refreshrate with the most even cadence for the emulator
+    if (refreshRateCount > 0) {
+        float refreshRate = FramePacer::SelectRefreshRate(supportedRefreshRates, emulator.DisplayRefreshRate);
+        if (vrapi_SetDisplayRefreshRate(GetSessionObject(), refreshRate) == ovrSuccess) {
+            OVR_LOG_WITH_TAG("OvrApp", "Refreshrate set to %f", refreshRate);
+            displayRate = refreshRate;
+        } else
+            OVR_LOG_WITH_TAG("OvrApp", "Failed to set refreshrate");
     }
+
+    emulator.SetDisplayRefreshRate(displayRate);
+}
+
+void ovrVirtualBoyGo::ReloadRoms() {
+    emulator.ScanRoms();
 }
 
 void ovrVirtualBoyGo::AppShutdown(const OVRFW::ovrAppContext *) {
@@ -182,7 +174,7 @@ void ovrVirtualBoyGo::AppShutdown(const OVRFW::ovrAppContext *) {
 
     global.Free();
 
-    openSlWrap.Shutdown();
+    audioOutput.Shutdown();
     ALOGV("AppShutdown - exit");
 }
 
@@ -202,6 +194,9 @@ OVRFW::ovrApplFrameOut ovrVirtualBoyGo::AppFrame(const OVRFW::ovrApplFrameIn &vr
 }
 
 void ovrVirtualBoyGo::AppRenderFrame(const OVRFW::ovrApplFrameIn &in, OVRFW::ovrRendererOutput &out) {
+    if (!initRefreshRate)
+        InitRefreshRate();
+
     // set up layers
     int& layerCount = NumLayers;
     layerCount = 0;
@@ -226,10 +221,17 @@ void ovrVirtualBoyGo::AppRenderFrame(const OVRFW::ovrApplFrameIn &in, OVRFW::ovr
 
     layerCount++;
 
+    // roms found by the background scan
+    emulator.UpdateRomList();
+
     // set up layers
-    menuGo.Update(dynamic_cast<ApplInterface &>(*this), dynamic_cast<ovrAppl &>(*this), in, out, Tracking);
+    {
+        TraceRecorder::Scope trace("MenuGo::Update");
+        menuGo.Update(dynamic_cast<ApplInterface &>(*this), dynamic_cast<ovrAppl &>(*this), in, out, Tracking);
+    }
 
     // render images for each eye
+    TraceRecorder::Scope trace("RenderEyes");
     for (int eye = 0; eye < GetNumFramebuffers(); ++eye) {
         ovrFramebuffer* framebuffer = GetFrameBuffer(eye);
         ovrFramebuffer_SetCurrent(framebuffer);
@@ -4,7 +4,6 @@
 #pragma once
 
 #include <FrontendGo/Menu.h>
-#include <FrontendGo/Audio/OpenSLWrap.h>
 #include "Emulator.h"
 #include "Menu.h"
 
@@ -51,6 +50,9 @@ public:
 
     virtual void AddLayerCylinder2(ovrLayerCylinder2 &layer) override;
 
+    // gets called from the java thread
+    void ReloadRoms();
+
 private:
     OVRFW::ovrFileSys *FileSys;
     OVRFW::OvrSceneView Scene;
@@ -62,12 +64,12 @@ private:
     DrawHelper drawHelper;
     FontManager fontManager;
 
-    OpenSLWrapper openSlWrap;
+    AudioOutput audioOutput;
 
     const ovrJava *java;
     jclass clsData;
 
-    bool initRefreshRate;
+    bool initRefreshRate = false;
 
     void InitRefreshRate();
 };
\ No newline at end of file